@@ -0,0 +1,661 @@
+#include "bakery.h"
+
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+struct BakerArgs
+{
+    Bakery *bakery;
+    int bakerIndex;
+};
+
+struct OvenArgs
+{
+    Bakery *bakery;
+    int ovenIndex;
+};
+
+// ------ Progress ticker --------
+// Real-time runs log the elapsed seconds once a second. The ticker sleeps on the
+// monotonic simulation clock instead of taking timer signals, and is not a clock actor.
+static pthread_mutex_t tickerLock = PTHREAD_MUTEX_INITIALIZER;
+static ClockCond tickerStop;
+static bool simulationFinished; // guarded by tickerLock
+
+static void *ticker(void *arg)
+{
+    pthread_mutex_lock(&tickerLock);
+    for (int second = 1;; second++)
+    {
+        long long deadline = second * NANOS_PER_SEC;
+        while (!simulationFinished && clockNow() < deadline)
+        {
+            clockCondTimedWait(&tickerStop, &tickerLock, deadline);
+        }
+        if (simulationFinished)
+        {
+            break;
+        }
+        logEvent(LogLevel::Info, EventType::Tick, ActorKind::Clock, 0, 0, second);
+    }
+    pthread_mutex_unlock(&tickerLock);
+    return nullptr;
+}
+
+static void stopTicker(pthread_t handler)
+{
+    pthread_mutex_lock(&tickerLock);
+    simulationFinished = true;
+    clockCondSignal(&tickerStop);
+    pthread_mutex_unlock(&tickerLock);
+    pthread_join(handler, nullptr);
+}
+// ------ End progress ticker --------
+
+Request readQueue(istream &in, int bakerIndex, const BakeryConfig &config)
+{
+    cout << "Bakery Queue number #" << bakerIndex;
+    string input, breadCountsInput;
+    cout << "\tInput customer names: " << endl;
+    getline(in, input);
+    cout << "Input each customer order: " << endl;
+    getline(in, breadCountsInput);
+
+    istringstream breadSS(breadCountsInput);
+    istringstream iss(input);
+    string word, breadCount;
+    vector<string> names;
+    vector<int> breadCounts;
+
+    while (iss >> word)
+    {
+        names.push_back(word);
+    }
+
+    while (breadSS >> breadCount)
+    {
+        int count = stoi(breadCount);
+        if (count > config.maxCustomerBreads || count <= 0)
+        {
+            cerr << "You can't order more than " << config.maxCustomerBreads << " or less than one! Exiting...\n";
+            exit(1);
+        }
+        breadCounts.push_back(count);
+    }
+
+    if (breadCounts.size() != names.size())
+    {
+        cerr << "invalid input. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+
+    Request request;
+    request.bakerIndex = bakerIndex;
+    for (size_t i = 0; i < breadCounts.size(); i++)
+    {
+        request.requests.push_back(std::make_pair(names[i], breadCounts[i]));
+    }
+    return request;
+}
+
+void orderPlaced(Bakery &bakery, Order &order)
+{
+    order.orderId = bakery.nextOrderId.fetch_add(1, memory_order_relaxed);
+    order.bakedBy = -1;
+    order.firstOven = -1;
+    order.timestamps = OrderTimestamps{};
+    order.timestamps.enqueuedAt = clockNow();
+    bakery.metrics.recordPlaced(order.bakerIndex);
+    logEvent(LogLevel::Debug, EventType::OrderPlaced, ActorKind::Customer, order.bakerIndex, order.customerId, order.breadCount, 0,
+             order.orderId);
+}
+
+void orderTaken(Bakery &bakery, int bakerIndex, Order &order)
+{
+    order.bakedBy = bakerIndex;
+    bakery.metrics.recordTaken(bakerIndex, order.bakerIndex, clockNow());
+    logEvent(LogLevel::Debug, EventType::OrderTaken, ActorKind::Baker, bakerIndex, order.customerId, order.breadCount, 0, order.orderId);
+}
+
+void orderHandedOver(Bakery &bakery, int bakerIndex, const Order &order)
+{
+    bakery.metrics.recordHandedOver(bakerIndex, order.bakerIndex, clockNow());
+    logEvent(LogLevel::Trace, EventType::OrderHandedOver, ActorKind::Baker, bakerIndex, order.customerId, order.breadCount, 0,
+             order.orderId);
+}
+
+void orderDelivered(Bakery &bakery, Order &order)
+{
+    order.timestamps.deliveredAt = clockNow();
+    bakery.metrics.recordDelivery(order.bakerIndex, order.timestamps, order.breadCount);
+    if (resultsEnabled)
+    {
+        resultsRecord(OrderResult{order.orderId, order.customerId, (uint32_t)order.bakerIndex, (uint32_t)order.bakedBy,
+                                  (uint32_t)order.firstOven, (uint32_t)order.breadCount, order.timestamps});
+    }
+    logEvent(LogLevel::Debug, EventType::OrderDelivered, ActorKind::Customer, order.bakerIndex, order.customerId, order.breadCount, 0,
+             order.orderId);
+}
+
+// ------ Work stealing --------
+// A queue is worth stealing from when orders wait in it while its own baker is busy.
+// Idle bakers announce themselves (BakerStation::idle, idleBakers) before re-checking for such
+// queues, and whoever adds a backlog checks for idle bakers after publishing it
+// (BakerStation::queuedOrders), so one side always sees the other.
+
+static int findVictim(Bakery &bakery, int thief)
+{
+    int victim = -1;
+    int backlog = 0;
+    for (int i = 0; i < bakery.config.bakerCount; i++)
+    {
+        int queued = bakery.stations[i].queuedOrders.load();
+        if (i != thief && queued > backlog && !bakery.stations[i].idle.load())
+        {
+            victim = i;
+            backlog = queued;
+        }
+    }
+    return victim;
+}
+
+static bool stealOrder(Bakery &bakery, int thief, Order &order)
+{
+    int victim = findVictim(bakery, thief);
+    if (victim < 0)
+    {
+        return false;
+    }
+    BakerStation &station = bakery.stations[victim];
+    profiledLock(&station.requestOrderLock);
+    bool stolen = !station.requestQueue.empty() && !station.idle.load();
+    if (stolen)
+    {
+        order = station.requestQueue.front();
+        station.requestQueue.pop();
+        station.queuedOrders.fetch_sub(1);
+    }
+    profiledUnlock(&station.requestOrderLock);
+    if (stolen)
+    {
+        bakery.metrics.recordSteal(thief);
+        logEvent(LogLevel::Debug, EventType::OrderStolen, ActorKind::Baker, thief, order.customerId, victim, 0, order.orderId);
+    }
+    return stolen;
+}
+
+// Wakes one idle baker other than `except`, if there is one.
+static void wakeIdleBaker(Bakery &bakery, int except)
+{
+    if (bakery.idleBakers.load() == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < bakery.config.bakerCount; i++)
+    {
+        if (i == except || !bakery.stations[i].idle.load())
+        {
+            continue;
+        }
+        BakerStation &station = bakery.stations[i];
+        profiledLock(&station.requestOrderLock);
+        bool idle = station.idle.load();
+        if (idle)
+        {
+            clockCondSignal(&station.requestOrderLockCondition);
+        }
+        profiledUnlock(&station.requestOrderLock);
+        if (idle)
+        {
+            return;
+        }
+    }
+}
+
+// Takes the baker's next order: from its own queue, or with work stealing from the
+// longest queue of a busy baker. Returns false once there is no work left for it.
+static bool takeOrder(Bakery &bakery, int bakerIndex, Order &order)
+{
+    BakerStation &station = bakery.stations[bakerIndex];
+    queue<Order> &requestQueue = station.requestQueue;
+    ProfiledMutex *requestOrderLock = &station.requestOrderLock;
+    ClockCond *requestOrderLockCondition = &station.requestOrderLockCondition;
+    bool stealing = bakery.config.workStealing;
+
+    profiledLock(requestOrderLock);
+    while (requestQueue.empty())
+    {
+        if (!stealing)
+        {
+            if (station.openCustomers == 0)
+            {
+                profiledUnlock(requestOrderLock);
+                return false;
+            }
+            clockCondWait(requestOrderLockCondition, requestOrderLock);
+            continue;
+        }
+
+        profiledUnlock(requestOrderLock);
+        if (stealOrder(bakery, bakerIndex, order))
+        {
+            return true;
+        }
+        profiledLock(requestOrderLock);
+
+        station.idle.store(true);
+        bakery.idleBakers.fetch_add(1);
+        bool work = !requestQueue.empty() || findVictim(bakery, bakerIndex) >= 0;
+        if (!work && bakery.openQueues.load() == 0)
+        {
+            station.idle.store(false);
+            bakery.idleBakers.fetch_sub(1);
+            profiledUnlock(requestOrderLock);
+            return false;
+        }
+        if (!work)
+        {
+            clockCondWait(requestOrderLockCondition, requestOrderLock);
+        }
+        station.idle.store(false);
+        bakery.idleBakers.fetch_sub(1);
+    }
+    order = requestQueue.front();
+    requestQueue.pop();
+    station.queuedOrders.fetch_sub(1);
+    bool backlog = !requestQueue.empty();
+    profiledUnlock(requestOrderLock);
+
+    // Now busy: what is left in the queue can go to an idle baker.
+    if (stealing && backlog)
+    {
+        wakeIdleBaker(bakery, bakerIndex);
+    }
+    return true;
+}
+// ------ End work stealing --------
+
+void placeOrder(Bakery &bakery, const Order &order)
+{
+    int bakerIndex = order.bakerIndex;
+    BakerStation &station = bakery.stations[bakerIndex];
+    Order queued = order;
+    profiledLock(&station.requestOrderLock);
+    orderPlaced(bakery, queued);
+    station.requestQueue.push(queued);
+    station.queuedOrders.fetch_add(1);
+    clockCondSignal(&station.requestOrderLockCondition);
+    profiledUnlock(&station.requestOrderLock);
+    if (bakery.config.workStealing && !station.idle.load())
+    {
+        wakeIdleBaker(bakery, bakerIndex);
+    }
+}
+
+void customerArrived(Bakery &bakery, int bakerIndex)
+{
+    BakerStation &station = bakery.stations[bakerIndex];
+    profiledLock(&station.requestOrderLock);
+    station.openCustomers++;
+    profiledUnlock(&station.requestOrderLock);
+}
+
+void customerDoneOrdering(Bakery &bakery, int bakerIndex)
+{
+    BakerStation &station = bakery.stations[bakerIndex];
+    profiledLock(&station.requestOrderLock);
+    bool queueClosed = --station.openCustomers == 0;
+    if (queueClosed)
+    {
+        clockCondSignal(&station.requestOrderLockCondition);
+    }
+    profiledUnlock(&station.requestOrderLock);
+
+    // Idle bakers stay around to steal until the last queue closes.
+    if (queueClosed && bakery.openQueues.fetch_sub(1) == 1 && bakery.config.workStealing)
+    {
+        for (int i = 0; i < bakery.config.bakerCount; i++)
+        {
+            profiledLock(&bakery.stations[i].requestOrderLock);
+            clockCondSignal(&bakery.stations[i].requestOrderLockCondition);
+            profiledUnlock(&bakery.stations[i].requestOrderLock);
+        }
+    }
+}
+
+Order receiveOrder(Bakery &bakery, int bakerIndex)
+{
+    Order response = bakery.stations[bakerIndex].deliveries.pop();
+    orderDelivered(bakery, response);
+    return response;
+}
+
+bool receiveOrderBefore(Bakery &bakery, int bakerIndex, long long deadline, Order &order)
+{
+    if (!bakery.stations[bakerIndex].deliveries.popBefore(deadline, order))
+    {
+        return false;
+    }
+    orderDelivered(bakery, order);
+    return true;
+}
+
+// The customer agents of the orderly queues, shared by single and multi mode.
+void *QueuedMode::customer(void *arg)
+{
+    auto *args = (CustomerArgs *)arg;
+    Bakery &bakery = *args->bakery;
+    int bakerIndex = args->bakerIndex;
+    OrderSource &source = *bakery.orders;
+    logEvent(LogLevel::Info, EventType::ActorStart, ActorKind::Customer, bakerIndex);
+
+    OrderSpec next;
+    bool hasNext = source.next(bakerIndex, next);
+    if (!hasNext)
+    {
+        customerDoneOrdering(bakery, bakerIndex);
+    }
+
+    if (source.closedLoop())
+    {
+        while (hasNext)
+        {
+            if (next.thinkTime > 0)
+            {
+                clockSleep(next.thinkTime);
+            }
+            Order order;
+            order.breadCount = next.breadCount;
+            order.customerId = next.customerId;
+            order.bakerIndex = bakerIndex;
+
+            // ------ Sending order --------
+            placeOrder(bakery, order);
+            hasNext = source.next(bakerIndex, next);
+            if (!hasNext)
+            {
+                customerDoneOrdering(bakery, bakerIndex);
+            }
+            // ------ End Sending order --------
+
+            // ------ Receiving Bread --------
+            receiveOrder(bakery, bakerIndex);
+            // ------ End Receiving Bread --------
+        }
+    }
+    else
+    {
+        // Open loop: customers keep arriving on schedule while earlier ones wait for their bread.
+        long long waiting = 0;
+        while (hasNext || waiting > 0)
+        {
+            if (hasNext && clockNow() >= next.arrivalAt)
+            {
+                Order order;
+                order.breadCount = next.breadCount;
+                order.customerId = next.customerId;
+                order.bakerIndex = bakerIndex;
+                placeOrder(bakery, order);
+                waiting++;
+                hasNext = source.next(bakerIndex, next);
+                if (!hasNext)
+                {
+                    customerDoneOrdering(bakery, bakerIndex);
+                }
+                continue;
+            }
+
+            Order delivered;
+            if (!hasNext)
+            {
+                receiveOrder(bakery, bakerIndex);
+                waiting--;
+            }
+            else if (receiveOrderBefore(bakery, bakerIndex, next.arrivalAt, delivered))
+            {
+                waiting--;
+            }
+        }
+    }
+
+    logEvent(LogLevel::Info, EventType::ActorEnd, ActorKind::Customer, bakerIndex);
+    clockActorExit();
+    pthread_exit(nullptr);
+}
+
+void QueuedMode::startCustomers(Bakery &bakery)
+{
+    int bakerCount = bakery.config.bakerCount;
+    customerHandlers.resize(bakerCount);
+    customerArgs.resize(bakerCount);
+    for (int i = 0; i < bakerCount; i++)
+    {
+        customerArgs[i].bakery = &bakery;
+        customerArgs[i].bakerIndex = i;
+        clockActorSpawn(&customerHandlers[i], &customer, &customerArgs[i]);
+    }
+}
+
+void QueuedMode::joinCustomers()
+{
+    for (pthread_t handler : customerHandlers)
+    {
+        pthread_join(handler, nullptr);
+    }
+    customerHandlers.clear();
+}
+
+void *baker(void *arg)
+{
+    auto *args = (BakerArgs *)arg;
+    Bakery &bakery = *args->bakery;
+    int bakerIndex = args->bakerIndex;
+    logEvent(LogLevel::Info, EventType::ActorStart, ActorKind::Baker, bakerIndex);
+
+    OrderCompletion *completion = &bakery.stations[bakerIndex].completion;
+    uint32_t ovenSeed = bakerIndex + 1;
+    auto ovenLoad = [&bakery](int i)
+    {
+        const Oven &oven = bakery.ovens[i];
+        return (double)oven.occupancy() / oven.capacity();
+    };
+
+    while (true)
+    {
+        // ------ Receive order --------
+        Order req;
+        if (!takeOrder(bakery, bakerIndex, req))
+        {
+            break;
+        }
+        orderTaken(bakery, bakerIndex, req);
+        // ------ End Receive order --------
+
+        // ------ Baking on the oven --------
+        orderCompletionStart(completion, req.breadCount);
+        // Each insertion takes as much of the rest of the order as the chosen oven has room for.
+        for (int inserted = 0; inserted < req.breadCount;)
+        {
+            int batch;
+            int ovenIndex = chooseOven(bakery.config, bakerIndex, ovenSeed, ovenLoad);
+            Oven &oven = bakery.ovens[ovenIndex];
+            long long insertedAt = oven.insertAvailable(bakerIndex, req.customerId, req.timestamps.enqueuedAt, inserted, req.breadCount - inserted, batch);
+            logEvent(LogLevel::Trace, EventType::BreadsIn, ActorKind::Baker, bakerIndex, req.customerId, batch, ovenIndex, req.orderId);
+            if (inserted == 0)
+            {
+                req.timestamps.firstBreadInAt = insertedAt;
+                req.firstOven = ovenIndex;
+            }
+            inserted += batch;
+        }
+        // ------ End baking on the oven --------
+
+        // ------ Waiting for the oven to bake. --------
+        orderCompletionWait(completion);
+        req.timestamps.lastBreadOutAt = completion->lastBreadOutAt;
+        logEvent(LogLevel::Debug, EventType::OrderBaked, ActorKind::Baker, bakerIndex, req.customerId, req.breadCount, 0, req.orderId);
+        // ------ End Waiting for the oven to bake. --------
+
+        // ------ Delivery to customer --------
+        // A stolen order still goes back to the queue its customer ordered from.
+        bakery.stations[req.bakerIndex].deliveries.push(req);
+        bakery.mode->orderReady(bakery, req.bakerIndex);
+        orderHandedOver(bakery, bakerIndex, req);
+        // ------ End Delivery to customer --------
+    }
+
+    logEvent(LogLevel::Info, EventType::ActorEnd, ActorKind::Baker, bakerIndex);
+    for (Oven &oven : bakery.ovens)
+    {
+        oven.bakerFinished();
+    }
+    clockActorExit();
+    pthread_exit(nullptr);
+}
+
+void *oven(void *arg)
+{
+    auto *args = (OvenArgs *)arg;
+    logEvent(LogLevel::Info, EventType::ActorStart, ActorKind::Oven, args->ovenIndex);
+    args->bakery->ovens[args->ovenIndex].run(args->ovenIndex);
+
+    logEvent(LogLevel::Info, EventType::ActorEnd, ActorKind::Oven, args->ovenIndex);
+    clockActorExit();
+    pthread_exit(nullptr);
+}
+
+// The pthread backend. Entered as a clock actor, which it stops being before it joins.
+static void runThreads(Bakery &bakery, BakeryMode &mode)
+{
+    //////////////// init threads, locks ////////////////
+    const BakeryConfig &config = bakery.config;
+    int bakerCount = config.bakerCount;
+    int ovenCount = config.ovens.size();
+    vector<pthread_t> oven_handler(ovenCount);
+    vector<OvenArgs> ovenArgs(ovenCount);
+    vector<pthread_t> baker_handler(bakerCount);
+    vector<BakerArgs> bakerArgs(bakerCount);
+
+    bakery.stations = vector<BakerStation>(bakerCount);
+    bakery.idleBakers.store(0);
+    bakery.openQueues.store(bakerCount);
+    vector<OrderCompletion *> completions(bakerCount);
+    for (int i = 0; i < bakerCount; i++)
+    {
+        BakerStation &station = bakery.stations[i];
+        profiledMutexInit(&station.requestOrderLock, LockName::RequestQueue);
+        clockCondInit(&station.requestOrderLockCondition);
+        station.openCustomers = 1;
+        station.queuedOrders.store(0);
+        station.idle.store(false);
+        orderCompletionInit(&station.completion);
+        station.deliveries.init(config.workStealing, !mode.orderlyQueues());
+        completions[i] = &station.completion;
+    }
+    // Completions are per baker, so an order may be split over several ovens.
+    bakery.ovens = vector<Oven>(ovenCount);
+    for (int i = 0; i < ovenCount; i++)
+    {
+        bakery.ovens[i].init(config.ovens[i].capacity, config.ovens[i].bakingTime, config.admission, completions);
+    }
+    statsStart(bakery, [&bakery](int i) { return OvenGauge{bakery.ovens[i].occupancy(), bakery.ovens[i].bakedBreads()}; });
+    /////////////////////////////////////////////////////////////
+
+    //////////////// create threads ////////////////
+    for (int i = 0; i < bakerCount; i++)
+    {
+        bakerArgs[i].bakery = &bakery;
+        bakerArgs[i].bakerIndex = i;
+        clockActorSpawn(&baker_handler[i], &baker, &bakerArgs[i]);
+    }
+    mode.startCustomers(bakery);
+    for (int i = 0; i < ovenCount; i++)
+    {
+        ovenArgs[i].bakery = &bakery;
+        ovenArgs[i].ovenIndex = i;
+        clockActorSpawn(&oven_handler[i], oven, &ovenArgs[i]);
+    }
+    clockActorExit();
+    ////////////////////////////////////////////////
+
+    //////////////// join threads ////////////////
+    mode.joinCustomers();
+    for (int i = 0; i < bakerCount; i++)
+    {
+        pthread_join(baker_handler[i], nullptr);
+    }
+    for (int i = 0; i < ovenCount; i++)
+    {
+        pthread_join(oven_handler[i], nullptr);
+    }
+    statsStop();
+    //////////////////////////////////////////////
+
+    ////////////////// destroy locks and conditions ////////////////
+    for (int i = 0; i < bakerCount; i++)
+    {
+        BakerStation &station = bakery.stations[i];
+        profiledMutexDestroy(&station.requestOrderLock);
+        clockCondDestroy(&station.requestOrderLockCondition);
+        orderCompletionDestroy(&station.completion);
+        station.deliveries.destroy();
+    }
+    for (int i = 0; i < ovenCount; i++)
+    {
+        bakery.metrics.recordOvenBreads(i, bakery.ovens[i].bakedBreads());
+        bakery.ovens[i].destroy();
+    }
+    ////////////////////////////////////////////////////////////////
+}
+
+long long runSimulation(Bakery &bakery, BakeryMode &mode)
+{
+    const BakeryConfig &config = bakery.config;
+    pthread_t ticker_handler;
+    bool racingCustomers = !mode.orderlyQueues() && config.backend == ExecutionBackend::Threads;
+    bakery.metrics.reset(config.bakerCount, config.workStealing, config.ovens.size(), racingCustomers);
+    bakery.mode = &mode;
+    if (config.lockProfile)
+    {
+        lockProfileStart();
+    }
+    scheduleStart(config.schedule);
+    simClockStart(config.virtualTime, config.schedule.mode != ScheduleMode::Free);
+    eventLogStart(config.log, bakery.orders);
+    resultsStart(config.resultsPath);
+    bakery.nextOrderId.store(0);
+    clockActorStart();
+    bool ticking = !config.virtualTime && config.log.level >= LogLevel::Info;
+    if (ticking)
+    {
+        simulationFinished = false;
+        clockCondInit(&tickerStop);
+        pthread_create(&ticker_handler, nullptr, &ticker, nullptr);
+    }
+    if (config.backend == ExecutionBackend::Coroutines)
+    {
+        runCoroutines(bakery, mode);
+    }
+    else
+    {
+        runThreads(bakery, mode);
+    }
+    long long elapsed = clockNow();
+
+    if (ticking)
+    {
+        stopTicker(ticker_handler);
+        clockCondDestroy(&tickerStop);
+    }
+    simClockStop();
+    scheduleStop();
+    eventLogStop();
+    resultsStop();
+    if (config.lockProfile)
+    {
+        lockProfileStop();
+    }
+    return elapsed;
+}
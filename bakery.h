@@ -0,0 +1,258 @@
+#ifndef BAKERY_H
+#define BAKERY_H
+
+#include <atomic>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include "eventlog.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "oven.h"
+#include "pthread.h"
+#include "results.h"
+#include "schedule.h"
+#include "sim_clock.h"
+#include "stats.h"
+#include "workload.h"
+
+enum class ExecutionBackend
+{
+    Threads,    // one pthread per baker, the oven and each customer agent
+    Coroutines, // C++20 coroutines on one worker thread per core (coro.cpp)
+};
+
+struct OvenConfig
+{
+    int capacity;   // max breads in the oven at once
+    int bakingTime; // seconds
+};
+
+// Runtime parameters shared by every mode. Defaults are filled in by main().
+struct BakeryConfig
+{
+    int bakerCount;        // number of baker threads (and customer queues)
+    std::vector<OvenConfig> ovens;
+    OvenPolicy ovenPolicy;
+    AdmissionPolicy admission; // which waiting baker an oven serves first
+    int maxCustomerBreads; // max number of breads a customer can order
+    bool virtualTime;
+    ExecutionBackend backend;
+    bool workStealing;     // idle bakers take orders queued behind busy ones (thread backend)
+    LogConfig log;
+    StatsConfig stats;     // live stats file, off if the path is empty
+    std::string resultsPath; // per-order results file (see results.h), off if empty
+    bool lockProfile;      // count lock contention for lockProfileReport()
+    ScheduleConfig schedule; // serialized, reproducible scheduling in virtual time
+};
+
+// Customers of one baker queue, in arrival order.
+struct Request
+{
+    int bakerIndex;
+    std::vector<std::pair<std::string, int>> requests;
+};
+
+struct Order
+{
+    uint64_t orderId;    // placement number within the run
+    uint32_t customerId; // name via orders->customerName()
+    int breadCount;
+    int bakerIndex;      // the queue it was placed in
+    int bakedBy;         // the baker that took it; another queue's with work stealing
+    int firstOven;       // the oven its first batch went into
+    OrderTimestamps timestamps;
+};
+
+// Deliveries of one baker queue: a bounded single-producer/single-consumer ring whose
+// producer and consumer ends sit on their own cache lines. With several producers (work
+// stealing) or consumers (chaos pickups) the matching side takes a short lock around each
+// operation. Blocking, when the ring is full or empty, goes through clock conditions.
+class alignas(64) DeliveryChannel
+{
+public:
+    DeliveryChannel() = default;
+    DeliveryChannel(const DeliveryChannel &) = delete;
+    DeliveryChannel &operator=(const DeliveryChannel &) = delete;
+
+    void init(bool multiProducer, bool multiConsumer);
+    void destroy();
+
+    void push(const Order &order);
+    Order pop();
+    // Like pop(), but gives up at `deadline` (clockNow() time) and returns false.
+    bool popBefore(long long deadline, Order &order);
+
+private:
+    static const unsigned CAPACITY = 64;
+
+    bool tryPop(Order &order);
+    bool empty() const;
+
+    alignas(64) std::atomic<unsigned long long> head; // consumer end
+    alignas(64) std::atomic<unsigned long long> tail; // producer end
+    alignas(64) Order slots[CAPACITY];
+
+    alignas(64) std::atomic<int> sleepingConsumers;
+    std::atomic<int> sleepingProducers;
+    bool multiProducer;
+    bool multiConsumer;
+    ProfiledMutex producerLock;
+    ProfiledMutex consumerLock;
+    ProfiledMutex waitLock;
+    ClockCond notEmpty;
+    ClockCond notFull;
+};
+
+// Everything that belongs to one baker queue. Stations are cache-line aligned and the
+// oven-facing completion and the delivery channel start lines of their own, so bakers
+// and customers working on different queues do not share cache lines.
+struct alignas(64) BakerStation
+{
+    // Orders waiting for the baker, guarded by requestOrderLock.
+    ProfiledMutex requestOrderLock;
+    ClockCond requestOrderLockCondition;
+    std::queue<Order> requestQueue;
+    int openCustomers; // ordering agents that may still send orders to this baker
+
+    // Read by other bakers without the lock; kept up to date in every run.
+    std::atomic<int> queuedOrders; // requestQueue.size()
+    std::atomic<bool> idle;        // baker waiting for work on its own queue (work stealing)
+
+    alignas(64) OrderCompletion completion; // the baker has one order in the oven at a time
+    DeliveryChannel deliveries;
+};
+
+class BakeryMode;
+
+// All state of one simulation run. Per-baker state lives in stations[bakerIndex].
+struct Bakery
+{
+    BakeryConfig config;
+    BakeryMode *mode;
+    std::vector<Request> requests; // stdin input, when not generating a workload
+    OrderSource *orders;
+
+    std::vector<BakerStation> stations; // one per baker queue
+
+    // Work stealing state shared by all bakers.
+    std::atomic<int> idleBakers;
+    std::atomic<int> openQueues; // queues whose openCustomers is still above zero
+
+    std::vector<Oven> ovens; // config.ovens.size() of them
+
+    std::atomic<uint64_t> nextOrderId;
+
+    MetricsCollector metrics;
+};
+
+// A simulation mode decides how customers reach the bakers; bakers and the oven are shared.
+// Every mode runs one ordering agent per baker queue that pulls the queue's orders from
+// bakery.orders and calls customerDoneOrdering() once the queue has run dry; agents that
+// hand orders to further customer threads register those with customerArrived().
+class BakeryMode
+{
+public:
+    virtual ~BakeryMode() = default;
+    virtual const char *name() const = 0;
+    virtual int bakerCount(const BakeryConfig &config) const { return config.bakerCount; }
+    // Fills bakery.requests, one entry per baker queue.
+    virtual void readInput(std::istream &in, Bakery &bakery) = 0;
+    virtual void startCustomers(Bakery &bakery) = 0;
+    virtual void joinCustomers() = 0;
+    // Called by a baker right after it put an order in its delivery queue.
+    virtual void orderReady(Bakery &bakery, int bakerIndex) {}
+    // Coroutine backend: true if each queue sends one order at a time, false if every
+    // customer races for the baker on its own.
+    virtual bool orderlyQueues() const { return true; }
+};
+
+// Orderly queues: one customer thread per baker queue, sending one order at a time.
+class QueuedMode : public BakeryMode
+{
+public:
+    void startCustomers(Bakery &bakery) override;
+    void joinCustomers() override;
+
+private:
+    struct CustomerArgs
+    {
+        Bakery *bakery;
+        int bakerIndex;
+    };
+    static void *customer(void *arg);
+
+    std::vector<pthread_t> customerHandlers;
+    std::vector<CustomerArgs> customerArgs;
+};
+
+BakeryMode *createSingleBakerMode();
+BakeryMode *createMultiBakerMode();
+BakeryMode *createChaosMode();
+
+// Reads one queue (a line of names and a line of bread counts) from `in`.
+Request readQueue(std::istream &in, int bakerIndex, const BakeryConfig &config);
+
+// Customer side of the baker protocol, used by the modes.
+void placeOrder(Bakery &bakery, const Order &order);
+void customerArrived(Bakery &bakery, int bakerIndex);
+// Called once per customer thread after it has placed its last order.
+void customerDoneOrdering(Bakery &bakery, int bakerIndex);
+Order receiveOrder(Bakery &bakery, int bakerIndex);
+// Like receiveOrder(), but gives up at `deadline` (clockNow() time) and returns false.
+bool receiveOrderBefore(Bakery &bakery, int bakerIndex, long long deadline, Order &order);
+
+// Order bookkeeping shared by the backends: orderPlaced() numbers the order, stamps
+// enqueuedAt and announces it; orderTaken() and orderHandedOver() mark baker `bakerIndex`
+// busy with it and free again; orderDelivered() stamps deliveredAt and records and
+// announces the delivery.
+void orderPlaced(Bakery &bakery, Order &order);
+void orderTaken(Bakery &bakery, int bakerIndex, Order &order);
+void orderHandedOver(Bakery &bakery, int bakerIndex, const Order &order);
+void orderDelivered(Bakery &bakery, Order &order);
+
+// Index of the oven that takes a baker's next batch under config.ovenPolicy. load(i)
+// returns oven i's occupied fraction; seed is the baker's own random state (non-zero).
+template <typename Load>
+int chooseOven(const BakeryConfig &config, int bakerIndex, uint32_t &seed, Load load)
+{
+    int ovenCount = config.ovens.size();
+    if (ovenCount == 1 || config.ovenPolicy == OvenPolicy::Static)
+    {
+        return bakerIndex % ovenCount;
+    }
+    if (config.ovenPolicy == OvenPolicy::LeastLoaded)
+    {
+        // Ties go to the baker's static oven, so idle ovens fill evenly.
+        int best = bakerIndex % ovenCount;
+        double bestLoad = load(best);
+        for (int step = 1; step < ovenCount; step++)
+        {
+            int i = (bakerIndex + step) % ovenCount;
+            double ovenLoad = load(i);
+            if (ovenLoad < bestLoad)
+            {
+                best = i;
+                bestLoad = ovenLoad;
+            }
+        }
+        return best;
+    }
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    int first = seed % ovenCount;
+    int second = (first + 1 + seed / ovenCount % (ovenCount - 1)) % ovenCount;
+    return load(second) < load(first) ? second : first;
+}
+
+// Runs the bakers, the ovens and the mode's customers to completion on config.backend.
+// Returns the elapsed clock time in nanoseconds.
+long long runSimulation(Bakery &bakery, BakeryMode &mode);
+// The coroutine backend. Entered as a clock actor; returns once every coroutine finished.
+void runCoroutines(Bakery &bakery, BakeryMode &mode);
+
+#endif
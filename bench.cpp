@@ -0,0 +1,416 @@
+#include "bakery.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+// Benchmark harness: runs the multi-baker and chaos engines in virtual time over a
+// grid of baker counts, oven counts, oven capacity multipliers and synthetic loads, and writes
+// one CSV/JSON row per run so results can be compared between commits.
+
+struct BenchOptions
+{
+    vector<string> modes;
+    vector<string> backends;
+    vector<int> bakerCounts;
+    vector<int> ovenCounts;
+    vector<int> capacityMultipliers;
+    vector<long long> loads;
+    int bakeTime;
+    int maxCustomerBreads;
+    bool workStealing;
+    bool lockProfile;
+    string ovenPolicy;
+    vector<string> admissions;
+    WorkloadConfig workload;
+    string csvPath;
+    string jsonPath;
+};
+
+struct BenchResult
+{
+    string mode;
+    string backend;
+    int bakers;
+    int ovens;
+    string ovenPolicy;
+    string admission;
+    int ovenCapacity; // over all ovens
+    long long orders;
+    long long breads;
+    long long steals;
+    double simulatedSeconds;
+    double wallSeconds;
+    double cpuSeconds;
+    LatencySummary latency;
+    double lockWaitSeconds; // over every profiled lock; 0 without --lock-profile
+    string topLock;         // the lock with the most wait, or "-"
+};
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " [options]\n"
+         << "  --modes LIST                 engines to run (default: multi,chaos)\n"
+         << "  --backends LIST              thread and/or coro (default: thread)\n"
+         << "  --bakers LIST                baker counts (default: 1,2,4,... up to the core count)\n"
+         << "  --ovens LIST                 oven counts (default: 1)\n"
+         << "  --oven-policy KIND           static, least-loaded or two-choices (default: static)\n"
+         << "  --admissions LIST            oven admission: fifo, shortest-first, fair-share,\n"
+         << "                               earliest-deadline (default: fifo)\n"
+         << "  --capacity-multipliers LIST  oven capacity per baker, split over the ovens (default: 5,10,20)\n"
+         << "  --loads LIST                 orders per run (default: 10,100,1000,10000)\n"
+         << "  --bake-time S                seconds per bread (default: 2)\n"
+         << "  --max-breads N               max breads per order (default: 15)\n"
+         << "  --work-stealing              let idle bakers steal queued orders (thread backend)\n"
+         << "  --lock-profile               fill lock_wait_s and top_lock (costs a clock read per lock)\n"
+         << "  --csv FILE                   write CSV here (default: stdout)\n"
+         << "  --json FILE                  also write JSON here\n"
+         << "workload shape (--orders is taken from --loads):\n"
+         << workloadUsage();
+    exit(EXIT_FAILURE);
+}
+
+vector<long long> parseList(const string &flag, const char *value, long long limit = LLONG_MAX)
+{
+    if (value == nullptr)
+    {
+        cerr << flag << " expects a comma separated list. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    vector<long long> numbers;
+    istringstream list(value);
+    string item;
+    while (getline(list, item, ','))
+    {
+        // Digits only, as in main's parsePositive().
+        char *end = nullptr;
+        errno = 0;
+        long long number = strtoll(item.c_str(), &end, 10);
+        if (item.empty() || item[0] < '0' || item[0] > '9' || *end != '\0' || number <= 0)
+        {
+            cerr << flag << " expects positive numbers. exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+        if (number > limit || errno == ERANGE)
+        {
+            cerr << flag << " expects numbers up to " << limit << ". exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+        numbers.push_back(number);
+    }
+    return numbers;
+}
+
+vector<int> toInts(const vector<long long> &numbers)
+{
+    return vector<int>(numbers.begin(), numbers.end());
+}
+
+double cpuNow()
+{
+    timespec now{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+double wallNow()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+BenchResult runOne(const string &modeName, const string &backend, int bakers, int ovens, const string &admission,
+                   int multiplier, long long orders, const BenchOptions &options)
+{
+    BakeryMode *mode = modeName == "chaos" ? createChaosMode() : createMultiBakerMode();
+
+    Bakery bakery;
+    bakery.config.bakerCount = bakers;
+    int ovenCapacity = (bakers * multiplier + ovens - 1) / ovens;
+    bakery.config.ovens.assign(ovens, OvenConfig{ovenCapacity, options.bakeTime});
+    parseOvenPolicy(options.ovenPolicy, bakery.config.ovenPolicy);
+    parseAdmissionPolicy(admission, bakery.config.admission);
+    bakery.config.maxCustomerBreads = options.maxCustomerBreads;
+    bakery.config.virtualTime = true;
+    bakery.config.workStealing = options.workStealing && backend == "thread";
+    // The event log would narrate every order; keep it out of the results.
+    bakery.config.log = LogConfig{LogLevel::Off, LogFormat::Text, ""};
+    bakery.config.stats = StatsConfig{"", 0};
+    bakery.config.lockProfile = options.lockProfile;
+    bakery.config.resultsPath = "";
+    bakery.config.schedule = ScheduleConfig{ScheduleMode::Free, "", 1};
+    bakery.config.backend = backend == "coro" ? ExecutionBackend::Coroutines : ExecutionBackend::Threads;
+    bakery.config.bakerCount = mode->bakerCount(bakery.config);
+
+    BenchResult result{};
+    result.mode = modeName;
+    result.backend = backend;
+    result.bakers = bakery.config.bakerCount;
+    result.ovens = ovens;
+    result.ovenPolicy = options.ovenPolicy;
+    result.admission = admission;
+    result.ovenCapacity = ovenCapacity * ovens;
+    result.orders = orders;
+    WorkloadConfig workload = options.workload;
+    workload.orders = orders;
+    WorkloadGenerator generator(workload, bakery.config.bakerCount, bakery.config.maxCustomerBreads);
+    bakery.orders = &generator;
+
+    double wallStart = wallNow();
+    double cpuStart = cpuNow();
+    long long elapsed = runSimulation(bakery, *mode);
+    result.cpuSeconds = cpuNow() - cpuStart;
+    result.wallSeconds = wallNow() - wallStart;
+
+    result.simulatedSeconds = (double)elapsed / NANOS_PER_SEC;
+    result.breads = bakery.metrics.deliveredBreads();
+    result.steals = 0;
+    for (int i = 0; i < result.bakers; i++)
+    {
+        result.steals += bakery.metrics.steals(i);
+    }
+    result.latency = bakery.metrics.orderToDelivery(-1).summary();
+    result.topLock = "-";
+    if (options.lockProfile)
+    {
+        vector<LockSummary> locks = lockProfileSummary();
+        for (const LockSummary &lock : locks)
+        {
+            result.lockWaitSeconds += (double)lock.waitNanos / NANOS_PER_SEC;
+        }
+        if (!locks.empty() && locks[0].waitNanos > 0)
+        {
+            result.topLock = locks[0].name;
+        }
+    }
+    delete mode;
+    return result;
+}
+
+double perSecond(double count, double seconds)
+{
+    return seconds > 0 ? count / seconds : 0;
+}
+
+void writeCsv(ostream &out, const vector<BenchResult> &results)
+{
+    out << "mode,backend,bakers,ovens,oven_policy,admission,oven_capacity,orders,breads,steals,simulated_s,sim_orders_per_s,sim_breads_per_s,"
+           "wall_s,wall_orders_per_s,wall_breads_per_s,cpu_s,latency_mean_s,latency_stddev_s,"
+           "latency_p50_s,latency_p90_s,latency_p99_s,latency_max_s,lock_wait_s,top_lock\n";
+    for (const BenchResult &r : results)
+    {
+        char row[512];
+        snprintf(row, sizeof(row), "%s,%s,%d,%d,%s,%s,%d,%lld,%lld,%lld,%.3f,%.3f,%.3f,%.6f,%.1f,%.1f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%s\n",
+                 r.mode.c_str(), r.backend.c_str(), r.bakers, r.ovens, r.ovenPolicy.c_str(), r.admission.c_str(), r.ovenCapacity, r.orders, r.breads, r.steals, r.simulatedSeconds,
+                 perSecond(r.orders, r.simulatedSeconds), perSecond(r.breads, r.simulatedSeconds), r.wallSeconds,
+                 perSecond(r.orders, r.wallSeconds), perSecond(r.breads, r.wallSeconds), r.cpuSeconds,
+                 r.latency.mean / 1e9, r.latency.stddev / 1e9, r.latency.p50 / 1e9, r.latency.p90 / 1e9,
+                 r.latency.p99 / 1e9, r.latency.max / 1e9, r.lockWaitSeconds, r.topLock.c_str());
+        out << row;
+    }
+}
+
+void writeJson(ostream &out, const vector<BenchResult> &results)
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        char row[1024];
+        snprintf(row, sizeof(row),
+                 "  {\"mode\": \"%s\", \"backend\": \"%s\", \"bakers\": %d, \"ovens\": %d, \"oven_policy\": \"%s\", \"admission\": \"%s\", \"oven_capacity\": %d, \"orders\": %lld, \"breads\": %lld, \"steals\": %lld, "
+                 "\"simulated_s\": %.3f, \"sim_orders_per_s\": %.3f, \"sim_breads_per_s\": %.3f, "
+                 "\"wall_s\": %.6f, \"wall_orders_per_s\": %.1f, \"wall_breads_per_s\": %.1f, \"cpu_s\": %.6f, "
+                 "\"latency_s\": {\"mean\": %.6f, \"stddev\": %.6f, \"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"max\": %.6f}, \"lock_wait_s\": %.6f, \"top_lock\": \"%s\"}%s\n",
+                 r.mode.c_str(), r.backend.c_str(), r.bakers, r.ovens, r.ovenPolicy.c_str(), r.admission.c_str(), r.ovenCapacity, r.orders, r.breads, r.steals, r.simulatedSeconds,
+                 perSecond(r.orders, r.simulatedSeconds), perSecond(r.breads, r.simulatedSeconds), r.wallSeconds,
+                 perSecond(r.orders, r.wallSeconds), perSecond(r.breads, r.wallSeconds), r.cpuSeconds,
+                 r.latency.mean / 1e9, r.latency.stddev / 1e9, r.latency.p50 / 1e9, r.latency.p90 / 1e9,
+                 r.latency.p99 / 1e9, r.latency.max / 1e9, r.lockWaitSeconds, r.topLock.c_str(), i + 1 < results.size() ? "," : "");
+        out << row;
+    }
+    out << "]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    options.modes = {"multi", "chaos"};
+    options.backends = {"thread"};
+    int cores = max(1u, thread::hardware_concurrency());
+    for (int bakers = 1; bakers < cores; bakers *= 2)
+    {
+        options.bakerCounts.push_back(bakers);
+    }
+    options.bakerCounts.push_back(cores);
+    options.ovenCounts = {1};
+    options.capacityMultipliers = {5, 10, 20};
+    options.loads = {10, 100, 1000, 10000};
+    options.bakeTime = 2;
+    options.maxCustomerBreads = 15;
+    options.workStealing = false;
+    options.lockProfile = false;
+    options.ovenPolicy = "static";
+    options.admissions = {"fifo"};
+    options.workload = defaultWorkloadConfig();
+
+    for (int i = 1; i < argc; i++)
+    {
+        string flag = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (flag == "--modes" && value != nullptr)
+        {
+            options.modes.clear();
+            istringstream list(value);
+            string mode;
+            while (getline(list, mode, ','))
+            {
+                if (mode != "multi" && mode != "chaos")
+                {
+                    usage(argv[0]);
+                }
+                options.modes.push_back(mode);
+            }
+        }
+        else if (flag == "--backends" && value != nullptr)
+        {
+            options.backends.clear();
+            istringstream list(value);
+            string backend;
+            while (getline(list, backend, ','))
+            {
+                if (backend != "thread" && backend != "coro")
+                {
+                    usage(argv[0]);
+                }
+                options.backends.push_back(backend);
+            }
+        }
+        else if (flag == "--bakers")
+        {
+            options.bakerCounts = toInts(parseList(flag, value, MAX_BAKERS));
+        }
+        else if (flag == "--ovens")
+        {
+            options.ovenCounts = toInts(parseList(flag, value, INT_MAX));
+        }
+        else if (flag == "--oven-policy" && value != nullptr)
+        {
+            options.ovenPolicy = value;
+            OvenPolicy policy;
+            if (!parseOvenPolicy(options.ovenPolicy, policy))
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (flag == "--admissions" && value != nullptr)
+        {
+            options.admissions.clear();
+            istringstream list(value);
+            string admission;
+            AdmissionPolicy policy;
+            while (getline(list, admission, ','))
+            {
+                if (!parseAdmissionPolicy(admission, policy))
+                {
+                    usage(argv[0]);
+                }
+                options.admissions.push_back(admission);
+            }
+        }
+        else if (flag == "--capacity-multipliers")
+        {
+            options.capacityMultipliers = toInts(parseList(flag, value, INT_MAX));
+        }
+        else if (flag == "--loads")
+        {
+            options.loads = parseList(flag, value);
+        }
+        else if (flag == "--bake-time")
+        {
+            options.bakeTime = parseList(flag, value)[0];
+        }
+        else if (flag == "--max-breads")
+        {
+            options.maxCustomerBreads = parseList(flag, value, MAX_ORDER_BREADS)[0];
+        }
+        else if (flag == "--work-stealing")
+        {
+            options.workStealing = true;
+            continue;
+        }
+        else if (flag == "--lock-profile")
+        {
+            options.lockProfile = true;
+            continue;
+        }
+        else if (flag != "--orders" && parseWorkloadFlag(flag, value, options.workload))
+        {
+        }
+        else if (flag == "--csv" && value != nullptr)
+        {
+            options.csvPath = value;
+        }
+        else if (flag == "--json" && value != nullptr)
+        {
+            options.jsonPath = value;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+        i++;
+    }
+
+    vector<BenchResult> results;
+    for (const string &mode : options.modes)
+    {
+        for (const string &backend : options.backends)
+        {
+            for (int bakers : options.bakerCounts)
+            {
+                for (int ovens : options.ovenCounts)
+                {
+                    for (const string &admission : options.admissions)
+                    {
+                        for (int multiplier : options.capacityMultipliers)
+                        {
+                            for (long long orders : options.loads)
+                            {
+                                cerr << "bench: " << mode << "/" << backend << " bakers=" << bakers << " ovens=" << ovens
+                                     << " admission=" << admission << " capacity=" << bakers * multiplier
+                                     << " orders=" << orders << " ... ";
+                                results.push_back(runOne(mode, backend, bakers, ovens, admission, multiplier, orders, options));
+                                cerr << results.back().wallSeconds << "s\n";
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (options.csvPath.empty())
+    {
+        writeCsv(cout, results);
+    }
+    else
+    {
+        ofstream csv(options.csvPath);
+        writeCsv(csv, results);
+    }
+    if (!options.jsonPath.empty())
+    {
+        ofstream json(options.jsonPath);
+        writeJson(json, results);
+    }
+    return 0;
+}
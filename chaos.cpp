@@ -1,409 +1,238 @@
-#include <iostream>
-#include <ctime>
-#include <queue>
-#include <vector>
-#include <sstream>
-#include <csignal>
-#include "pthread.h"
-#include "unistd.h"
-#include "semaphore.h"
+#include "bakery.h"
 
-#define BAKER_COUNT 3          // number of baker threads
-#define OVEN_BAKING_TIME 2     // seconds
-#define MAX_CUSTOMER_BREADS 15 // Max number of breads a customer can order
+#include <random>
+#include <thread>
 
 using namespace std;
 
-const int OVEN_MAX_CAPACITY = BAKER_COUNT * 10;
-static int clockSec = 0;
-
-struct Request
-{
-    int bakerIndex;
-    vector<pair<string, int>> requests;
-};
-
-struct ChaosRequest
+// Chaos mode: customers race each other to their baker. Each customer is a pair of small
+// tasks run by a fixed pool of workers, so the customer count is not limited by threads.
+// Workers take the pool's tasks in random order, seeded with the schedule seed, so who
+// reaches the counter and who collects a delivery first is decided by the race, not by the
+// arrival order, and a seeded or replayed run still repeats it.
+class ChaosMode : public BakeryMode
 {
-    int bakerIndex;
-    pair<string, int> request;
-};
-
-struct Order
-{
-    string customerName;
-    int breadCount;
-};
-
-struct Bread
-{
-    int bakingStartTime;
-    int index;
-    string customerName;
-};
-
-static bool customerFinished[BAKER_COUNT];
-static bool bakerFinished[BAKER_COUNT];
-static bool ovenFinished; // There is only one oven!
-
-pthread_mutex_t sharedSpaceLock = PTHREAD_MUTEX_INITIALIZER; // There is only one shared space!
-pthread_mutex_t requestOrderLocks[BAKER_COUNT];
-pthread_mutex_t ovenLock = PTHREAD_MUTEX_INITIALIZER;
-
-pthread_cond_t sharedSpaceLockCondition[BAKER_COUNT];
-pthread_cond_t requestOrderLockConditions[BAKER_COUNT];
-
-queue<Bread> ovenBreadQueue;
-queue<Order> requestQueues[BAKER_COUNT];
-queue<Order> deliveryQueues[BAKER_COUNT];
+public:
+    const char *name() const override { return "chaos"; }
+    bool orderlyQueues() const override { return false; }
 
-sem_t ovenEmptySlots;
-sem_t ovenFullSlots;
-
-void mySigHandler(int signo)
-{
-    printf("Time elapsed: #%d seconds\n", ++clockSec);
-}
-
-bool isAllBakersFinished()
-{
-    for (int i = 0; i < BAKER_COUNT; i++)
+    void readInput(istream &in, Bakery &bakery) override
     {
-        if (!bakerFinished[i])
+        for (int i = 0; i < bakery.config.bakerCount; i++)
         {
-            return false;
+            bakery.requests.push_back(readQueue(in, i, bakery.config));
         }
     }
-    return true;
-}
-
-void *timer_thread(void *arg)
-{
-    struct sigaction signalAction{};
-    signalAction.sa_flags = 0;
-    signalAction.sa_handler = mySigHandler;
-    sigemptyset(&signalAction.sa_mask);
-
-    int signo = SIGRTMIN;
 
-    if (sigaction(signo, &signalAction, nullptr) == -1)
+    void startCustomers(Bakery &bakery) override
     {
-        perror("sigaction");
-        pthread_exit(nullptr);
-    }
+        int bakerCount = bakery.config.bakerCount;
+        int workerCount = max(1u, thread::hardware_concurrency());
+        this->bakery = &bakery;
+        profiledMutexInit(&poolLock, LockName::ChaosPool);
+        clockCondInit(&taskAvailable);
+        clockCondInit(&arrivalSpace);
+        queuedArrivals = 0;
+        maxQueuedArrivals = 64 * workerCount;
+        customersWaiting = 0;
+        spawnersRunning = bakerCount;
+        taskPicker.seed(scheduleSeed());
+        lastServed.assign(bakerCount, -1);
 
-    sigset_t mask;
-    sigemptyset(&mask);
-    sigaddset(&mask, signo);
-    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
-
-    timer_t timer_id;
-    struct sigevent sev{};
-    sev.sigev_notify = SIGEV_SIGNAL;
-    sev.sigev_signo = signo;
-    sev.sigev_value.sival_ptr = &timer_id;
-
-    if (timer_create(CLOCK_REALTIME, &sev, &timer_id) == -1)
-    {
-        perror("timer_create");
-        pthread_exit(nullptr);
-    }
-
-    struct itimerspec timerSpec{};
-    timerSpec.it_value.tv_sec = 1;
-    timerSpec.it_value.tv_nsec = 0;
-    timerSpec.it_interval.tv_sec = 1;
-    timerSpec.it_interval.tv_nsec = 0;
-
-    if (timer_settime(timer_id, 0, &timerSpec, nullptr) == -1)
-    {
-        perror("timer_settime");
-        pthread_exit(nullptr);
-    }
-
-    while (!ovenFinished)
-    {
-        pause();
-    }
-
-    pthread_exit(nullptr);
-}
-
-void clockInit()
-{
-    sigset_t mask;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGRTMIN);
-    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
-}
-
-void getInput(vector<int> &breadCounts, vector<string> &names, const int &queueNumber)
-{
-    cout << "Bakery Queue number #" << queueNumber;
-    string input, breadCountsInput;
-    cout << "\tInput customer names: " << endl;
-    getline(cin, input);
-    cout << "Input each customer order: " << endl;
-    getline(cin, breadCountsInput);
-
-    istringstream breadSS(breadCountsInput);
-    istringstream iss(input);
-    string word, breadCount;
-
-    while (iss >> word)
-    {
-        names.push_back(word);
+        workerHandlers.resize(workerCount);
+        for (int i = 0; i < workerCount; i++)
+        {
+            clockActorSpawn(&workerHandlers[i], &worker, this);
+        }
+        spawners.resize(bakerCount);
+        spawnerHandlers.resize(bakerCount);
+        for (int i = 0; i < bakerCount; i++)
+        {
+            spawners[i].mode = this;
+            spawners[i].bakerIndex = i;
+            spawners[i].arrivals = 0;
+            clockActorSpawn(&spawnerHandlers[i], &spawner, &spawners[i]);
+        }
     }
 
-    while (breadSS >> breadCount)
+    void joinCustomers() override
     {
-        int count = stoi(breadCount);
-        if (count > MAX_CUSTOMER_BREADS || count <= 0)
+        for (pthread_t handler : spawnerHandlers)
         {
-            cerr << "You can't order more than " << MAX_CUSTOMER_BREADS << " or less than one! Exiting...\n";
-            exit(1);
+            pthread_join(handler, nullptr);
         }
-        breadCounts.push_back(count);
+        for (pthread_t handler : workerHandlers)
+        {
+            pthread_join(handler, nullptr);
+        }
+        spawnerHandlers.clear();
+        spawners.clear();
+        workerHandlers.clear();
+        tasks.clear();
+        profiledMutexDestroy(&poolLock);
+        clockCondDestroy(&taskAvailable);
+        clockCondDestroy(&arrivalSpace);
     }
-}
 
-void createRequest(Request &request, const int &queueNumber)
-{
-    vector<string> names;
-    vector<int> breadCounts;
-
-    getInput(breadCounts, names, queueNumber);
-
-    if (breadCounts.size() != names.size())
-    {
-        cerr << "invalid input. exiting...\n";
-        exit(EXIT_FAILURE);
-    }
-    for (size_t i = 0; i < breadCounts.size(); i++)
+    // Whoever runs the pickup first gets the bread, as when customers crowded the counter.
+    void orderReady(Bakery &bakery, int bakerIndex) override
     {
-        request.requests.push_back(std::make_pair(names[i], breadCounts[i]));
+        profiledLock(&poolLock);
+        tasks.push_back(CustomerTask{TaskKind::Pickup, 0, bakerIndex, 0, 0});
+        clockCondSignal(&taskAvailable);
+        profiledUnlock(&poolLock);
     }
-}
-
-void *customer(void *req)
-{
-    auto *request = (ChaosRequest *)(req);
-    int bakerIndex = request->bakerIndex;
-    string customerQueueName = "Customer_" + request->request.first + to_string(bakerIndex) + ' ';
-    printf("%s THREAD started.\n", customerQueueName.c_str());
 
-    queue<Order> *requestQueue = &requestQueues[bakerIndex];
-    queue<Order> *deliveryQueue = &deliveryQueues[bakerIndex];
-    pthread_mutex_t *requestOrderLock = &requestOrderLocks[bakerIndex];
-    pthread_cond_t *requestOrderLockCondition = &requestOrderLockConditions[bakerIndex];
-
-    Order order;
-    order.breadCount = request->request.second;
-    order.customerName = request->request.first;
-
-    // ------ Sending order --------
-    pthread_mutex_lock(requestOrderLock);
-    requestQueue->push(order);
-    printf("Customer %s is ordering %d breads to baker #%d \n", order.customerName.c_str(), order.breadCount, bakerIndex);
-    pthread_cond_signal(requestOrderLockCondition);
-    pthread_mutex_unlock(requestOrderLock);
-    // ------ End Sending order --------
-
-    // ------ Receiving Bread --------
-    pthread_mutex_lock(&sharedSpaceLock);
-    while (deliveryQueue->empty())
+private:
+    enum class TaskKind : uint8_t
     {
-        pthread_cond_wait(&sharedSpaceLockCondition[bakerIndex], &sharedSpaceLock);
-    }
-    auto response = deliveryQueue->front();
-    deliveryQueue->pop();
-    cout << "Customer: " << response.customerName << " Received " << response.breadCount << " breads and is leaving...\n\n";
-    pthread_mutex_unlock(&sharedSpaceLock);
-    // ------ End Receiving Bread --------
-
-    customerFinished[bakerIndex] = true;
-    printf("%s thread ended.\n", customerQueueName.c_str());
-    pthread_exit(nullptr);
-}
-
-void *baker(void *arg)
-{
-    int bakerIndex = *(int *)arg;
-    string bakerName = "Baker_" + to_string(bakerIndex) + ' ';
-    cout << bakerName << "thread starting...\n\n";
+        Arrive, // place the order
+        Pickup, // collect a delivered order and leave
+    };
 
-    queue<Order> *requestQueue = &requestQueues[bakerIndex];
-    queue<Order> *deliveryQueue = &deliveryQueues[bakerIndex];
-    pthread_mutex_t *requestOrderLock = &requestOrderLocks[bakerIndex];
-    pthread_cond_t *requestOrderLockCondition = &requestOrderLockConditions[bakerIndex];
+    struct CustomerTask
+    {
+        TaskKind kind;
+        uint32_t customerId;
+        int bakerIndex;
+        int breadCount;
+        long long arrival; // Arrive: the customer's place in its queue's arrival order
+    };
 
-    while (!customerFinished[bakerIndex])
+    // Lets the customers of one queue in as they arrive.
+    struct Spawner
     {
-        // ------ Receive order --------
-        pthread_mutex_lock(requestOrderLock);
-        while (requestQueue->empty() && !customerFinished[bakerIndex])
-        {
-            pthread_cond_wait(requestOrderLockCondition, requestOrderLock);
-        }
-        if (customerFinished[bakerIndex])
-        {
-            break;
-        }
-        auto req = requestQueue->front();
-        requestQueue->pop();
-        pthread_mutex_unlock(requestOrderLock);
-        // ------ End Receive order --------
+        ChaosMode *mode;
+        int bakerIndex;
+        long long arrivals;
+    };
 
-        // ------ Baking on the oven --------
-        for (int i = 0; i < req.breadCount; i++)
-        {
-            Bread bread;
-            bread.bakingStartTime = clockSec;
-            bread.customerName = req.customerName;
-            bread.index = i;
-            sem_wait(&ovenEmptySlots);
-            pthread_mutex_lock(&ovenLock);
-            // printf("%s : creating bread %s_%d\n", bakerName.c_str(), bread.customerName.c_str(), bread.index);
-            ovenBreadQueue.push(bread);
-            pthread_mutex_unlock(&ovenLock);
-            sem_post(&ovenFullSlots);
-        }
-        // ------ End baking on the oven --------
+    static void *spawner(void *arg)
+    {
+        auto *spawner = (Spawner *)arg;
+        ChaosMode &mode = *spawner->mode;
+        Bakery &bakery = *mode.bakery;
+        int bakerIndex = spawner->bakerIndex;
+        OrderSource &source = *bakery.orders;
 
-        // ------ Waiting for the oven to bake. --------
-        while (!ovenBreadQueue.empty())
+        OrderSpec next;
+        while (source.next(bakerIndex, next))
         {
-            sleep(1);
+            if (!source.closedLoop() && clockNow() < next.arrivalAt)
+            {
+                clockSleepUntil(next.arrivalAt);
+            }
+            customerArrived(bakery, bakerIndex);
+
+            // Bounded hand-off: customers not yet through the door stay in the order source.
+            profiledLock(&mode.poolLock);
+            while (mode.queuedArrivals >= mode.maxQueuedArrivals)
+            {
+                clockCondWait(&mode.arrivalSpace, &mode.poolLock);
+            }
+            mode.tasks.push_back(CustomerTask{TaskKind::Arrive, next.customerId, bakerIndex, next.breadCount, spawner->arrivals++});
+            mode.queuedArrivals++;
+            mode.customersWaiting++;
+            clockCondSignal(&mode.taskAvailable);
+            profiledUnlock(&mode.poolLock);
         }
-        // ------ End Waiting for the oven to bake. --------
+        customerDoneOrdering(bakery, bakerIndex);
 
-        // ------ Delivery to customer --------
-        pthread_mutex_lock(&sharedSpaceLock);
-        deliveryQueue->push(req);
-        pthread_cond_signal(&sharedSpaceLockCondition[bakerIndex]);
-        pthread_mutex_unlock(&sharedSpaceLock);
-        sleep(1);
-        // ------ End Delivery to customer --------
+        profiledLock(&mode.poolLock);
+        mode.spawnersRunning--;
+        clockCondBroadcast(&mode.taskAvailable);
+        profiledUnlock(&mode.poolLock);
+        clockActorExit();
+        pthread_exit(nullptr);
     }
 
-    printf("%s thread ending...\n", bakerName.c_str());
-    bakerFinished[bakerIndex] = true;
-    pthread_exit(nullptr);
-}
-
-void *oven(void *arg)
-{
-    cout << "\nOven thread starting...\n\n";
-    while (true)
+    static void *worker(void *arg)
     {
-        int capacity;
-        sem_getvalue(&ovenEmptySlots, &capacity);
-
-        if (isAllBakersFinished() && capacity == OVEN_MAX_CAPACITY)
+        ChaosMode &mode = *(ChaosMode *)arg;
+        profiledLock(&mode.poolLock);
+        while (true)
         {
-            break;
-        }
-        if (ovenBreadQueue.empty())
-        {
-            continue;
-        }
-
-        auto bread = ovenBreadQueue.front();
-        if (clockSec - bread.bakingStartTime >= OVEN_BAKING_TIME)
-        {
-            // cout << "Oven: time to put " << bread.customerName << "_" << bread.index << " out!!\n";
-            sem_wait(&ovenFullSlots);
-            pthread_mutex_lock(&ovenLock);
-            ovenBreadQueue.pop();
-            pthread_mutex_unlock(&ovenLock);
-            sem_post(&ovenEmptySlots);
+            if (mode.tasks.empty())
+            {
+                if (mode.spawnersRunning == 0 && mode.customersWaiting == 0)
+                {
+                    break;
+                }
+                clockCondWait(&mode.taskAvailable, &mode.poolLock);
+                continue;
+            }
+
+            size_t pick = mode.taskPicker() % mode.tasks.size();
+            CustomerTask task = mode.tasks[pick];
+            mode.tasks[pick] = mode.tasks.back();
+            mode.tasks.pop_back();
+            if (task.kind == TaskKind::Arrive)
+            {
+                mode.queuedArrivals--;
+                clockCondSignal(&mode.arrivalSpace);
+                long long &lastServed = mode.lastServed[task.bakerIndex];
+                if (task.arrival < lastServed)
+                {
+                    mode.bakery->metrics.recordOvertake(task.bakerIndex);
+                }
+                lastServed = max(lastServed, task.arrival);
+            }
+            profiledUnlock(&mode.poolLock);
+            runTask(*mode.bakery, task);
+            profiledLock(&mode.poolLock);
+            if (task.kind == TaskKind::Pickup && --mode.customersWaiting == 0 && mode.spawnersRunning == 0)
+            {
+                clockCondBroadcast(&mode.taskAvailable);
+            }
         }
+        profiledUnlock(&mode.poolLock);
+        clockActorExit();
+        pthread_exit(nullptr);
     }
 
-    ovenFinished = true;
-    cout << "Oven thread ending...\n";
-    pthread_exit(nullptr);
-}
-
-int main(int argc, char *argv[])
-{
-    //////////////// input and init threads, clock, locks ////////////////
-    sem_init(&ovenEmptySlots, 0, OVEN_MAX_CAPACITY);
-    sem_init(&ovenFullSlots, 0, 0);
-    clockInit();
-
-    vector<Request> reqs(BAKER_COUNT);
-    int customerCount = 0;
-    for (int i = 0; i < BAKER_COUNT; i++)
+    static void runTask(Bakery &bakery, const CustomerTask &task)
     {
-        bakerFinished[i] = false;
-        customerFinished[i] = false;
-        pthread_mutex_init(&requestOrderLocks[i], nullptr);
-        pthread_cond_init(&requestOrderLockConditions[i], nullptr);
-        pthread_cond_init(&sharedSpaceLockCondition[i], nullptr);
-
-        Request request;
-        createRequest(request, i);
-        customerCount += request.requests.size();
-        request.bakerIndex = i;
-        reqs[i] = request;
-    }
-    pthread_t timer_handler, customer_handler[customerCount], baker_handler[BAKER_COUNT], oven_handler;
-
-    /////////////////////////////////////////////////////////////////////////
-
-    cout << "\n\n**** Starting program **** \n\n";
-    time_t progStart = time(nullptr);
+        int bakerIndex = task.bakerIndex;
+        if (task.kind == TaskKind::Arrive)
+        {
+            logEvent(LogLevel::Debug, EventType::CustomerArrived, ActorKind::Customer, bakerIndex, task.customerId);
 
-    //////////////// create threads ////////////////
-    pthread_create(&timer_handler, nullptr, &timer_thread, nullptr);
-    int count = 0;
-    for (int i = 0; i < BAKER_COUNT; i++)
-    {
-        int *bakerIndex = (int *)malloc(sizeof(int));
-        *bakerIndex = i;
-        pthread_create(&baker_handler[i], nullptr, &baker, bakerIndex);
+            Order order;
+            order.breadCount = task.breadCount;
+            order.customerId = task.customerId;
+            order.bakerIndex = bakerIndex;
 
-        for (int j = 0; j < reqs[i].requests.size(); j++)
+            // ------ Sending order --------
+            placeOrder(bakery, order);
+            customerDoneOrdering(bakery, bakerIndex);
+            // ------ End Sending order --------
+        }
+        else
         {
-            auto* newReq = (ChaosRequest*) malloc(sizeof(ChaosRequest));
-            newReq->bakerIndex = i;
-            newReq->request = reqs[i].requests[j];
-            pthread_create(&customer_handler[count++], nullptr, &customer, newReq);
+            // ------ Receiving Bread --------
+            receiveOrder(bakery, bakerIndex);
+            // ------ End Receiving Bread --------
         }
     }
-    pthread_create(&oven_handler, nullptr, oven, nullptr);
-    ////////////////////////////////////////////////
-
-    //////////////// join threads ////////////////
-    for (int i = 0; i < customerCount; i++)
-    {
-        pthread_join(customer_handler[i], nullptr);
-    }
-
-    for (int i = 0; i < BAKER_COUNT; i++)
-    {
-        pthread_join(baker_handler[i], nullptr);
-    }
-    pthread_join(oven_handler, nullptr);
-    pthread_join(timer_handler, nullptr);
-    //////////////////////////////////////////////
 
-    ////////////////// destroy locks and conditions ////////////////
-    pthread_mutex_destroy(&sharedSpaceLock);
-    for (int i = 0; i < BAKER_COUNT; i++)
-    {
-        pthread_mutex_destroy(&requestOrderLocks[i]);
-        pthread_cond_destroy(&requestOrderLockConditions[i]);
-        pthread_cond_destroy(&sharedSpaceLockCondition[i]);
-    }
-    pthread_mutex_destroy(&ovenLock);
-    sem_destroy(&ovenEmptySlots);
-    sem_destroy(&ovenFullSlots);
-    ////////////////////////////////////////////////////////////////
-
-    cout << "\n\n**** Ending program **** \n\n";
-    cout << "Total Execution time: " << time(nullptr) - progStart << " Seconds.\n";
+    Bakery *bakery;
+    vector<Spawner> spawners;
+    vector<pthread_t> spawnerHandlers;
+    vector<pthread_t> workerHandlers;
+
+    ProfiledMutex poolLock;
+    ClockCond taskAvailable;
+    ClockCond arrivalSpace;
+    vector<CustomerTask> tasks; // taken in random order
+    mt19937_64 taskPicker;
+    vector<long long> lastServed; // per queue, the latest arrival that reached the counter
+    int queuedArrivals;
+    int maxQueuedArrivals;
+    long long customersWaiting; // arrived and not yet gone home with their bread
+    int spawnersRunning;
+};
 
-    return 0;
+BakeryMode *createChaosMode()
+{
+    return new ChaosMode();
 }
@@ -0,0 +1,731 @@
+#include "bakery.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <queue>
+#include <thread>
+
+using namespace std;
+
+// Coroutine backend: customers, bakers and the oven are C++20 coroutines run by a small
+// executor with one worker thread per core. Only the workers are clock actors; a
+// coroutine that waits is parked in a queue instead of blocking its thread, so an idle
+// worker waits on a clock condition (timed by the next sleeping coroutine) and virtual
+// time works exactly as with the thread backend.
+//
+// Awaiters hand their coroutine to another thread while still inside await_suspend(),
+// so they never touch their own members after releasing the lock that published them.
+
+class Executor;
+
+// Fire-and-forget coroutine. The executor counts it as live until its frame is destroyed.
+struct Task
+{
+    struct promise_type
+    {
+        Executor *executor = nullptr;
+
+        Task get_return_object() { return Task{coroutine_handle<promise_type>::from_promise(*this)}; }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+        ~promise_type();
+    };
+
+    coroutine_handle<promise_type> handle;
+};
+
+class Executor
+{
+public:
+    Executor()
+    {
+        profiledMutexInit(&lock, LockName::CoroExecutor);
+        clockCondInit(&workAvailable);
+        liveTasks = 0;
+        idleWorkers = 0;
+        timerSequence = 0;
+    }
+
+    ~Executor()
+    {
+        profiledMutexDestroy(&lock);
+        clockCondDestroy(&workAvailable);
+    }
+
+    void spawn(Task task)
+    {
+        task.handle.promise().executor = this;
+        profiledLock(&lock);
+        liveTasks++;
+        profiledUnlock(&lock);
+        schedule(task.handle);
+    }
+
+    // Makes a suspended coroutine runnable.
+    void schedule(coroutine_handle<> handle)
+    {
+        profiledLock(&lock);
+        ready.push_back(handle);
+        if (idleWorkers > 0)
+        {
+            clockCondSignal(&workAvailable);
+        }
+        profiledUnlock(&lock);
+    }
+
+    void taskFinished()
+    {
+        profiledLock(&lock);
+        if (--liveTasks == 0)
+        {
+            clockCondBroadcast(&workAvailable);
+        }
+        profiledUnlock(&lock);
+    }
+
+    struct SleepAwaiter
+    {
+        Executor *executor;
+        long long deadline;
+
+        bool await_ready() const { return clockNow() >= deadline; }
+        void await_suspend(coroutine_handle<> handle) { executor->addTimer(deadline, handle); }
+        void await_resume() const {}
+    };
+
+    SleepAwaiter sleepUntil(long long deadline) { return SleepAwaiter{this, deadline}; }
+
+    // Runs workers until every spawned coroutine has finished. The caller is a clock actor until
+    // the workers are started.
+    void run(int workerCount)
+    {
+        vector<pthread_t> workers(workerCount);
+        for (pthread_t &handler : workers)
+        {
+            clockActorSpawn(&handler, &worker, this);
+        }
+        clockActorExit();
+        for (pthread_t handler : workers)
+        {
+            pthread_join(handler, nullptr);
+        }
+    }
+
+private:
+    struct Timer
+    {
+        long long deadline;
+        unsigned long long sequence; // keeps equal deadlines in FIFO order
+        coroutine_handle<> handle;
+    };
+
+    struct TimerLater
+    {
+        bool operator()(const Timer &a, const Timer &b) const
+        {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence;
+        }
+    };
+
+    // The worker that suspends the coroutine goes back to its loop and sees the new timer.
+    void addTimer(long long deadline, coroutine_handle<> handle)
+    {
+        profiledLock(&lock);
+        timers.push(Timer{deadline, timerSequence++, handle});
+        profiledUnlock(&lock);
+    }
+
+    static void *worker(void *arg)
+    {
+        Executor &executor = *(Executor *)arg;
+        profiledLock(&executor.lock);
+        while (true)
+        {
+            long long now = clockNow();
+            while (!executor.timers.empty() && executor.timers.top().deadline <= now)
+            {
+                executor.ready.push_back(executor.timers.top().handle);
+                executor.timers.pop();
+            }
+
+            if (!executor.ready.empty())
+            {
+                coroutine_handle<> handle = executor.ready.front();
+                executor.ready.pop_front();
+                profiledUnlock(&executor.lock);
+                handle.resume();
+                profiledLock(&executor.lock);
+                continue;
+            }
+
+            if (executor.liveTasks == 0)
+            {
+                break;
+            }
+            executor.idleWorkers++;
+            if (executor.timers.empty())
+            {
+                clockCondWait(&executor.workAvailable, &executor.lock);
+            }
+            else
+            {
+                clockCondTimedWait(&executor.workAvailable, &executor.lock, executor.timers.top().deadline);
+            }
+            executor.idleWorkers--;
+        }
+        profiledUnlock(&executor.lock);
+        clockActorExit();
+        pthread_exit(nullptr);
+    }
+
+    ProfiledMutex lock;
+    ClockCond workAvailable;
+    deque<coroutine_handle<>> ready;
+    priority_queue<Timer, vector<Timer>, TimerLater> timers;
+    unsigned long long timerSequence;
+    long long liveTasks;
+    int idleWorkers;
+};
+
+Task::promise_type::~promise_type()
+{
+    if (executor != nullptr)
+    {
+        executor->taskFinished();
+    }
+}
+
+// Unbounded multi-producer/multi-consumer queue; pop() suspends until an item arrives
+// or the channel is closed and drained (then it yields nullopt). Waiters are served in order.
+template <typename T>
+class Channel
+{
+public:
+    explicit Channel(Executor &executor) : executor(executor), closed(false)
+    {
+        profiledMutexInit(&lock, LockName::CoroChannel);
+    }
+
+    ~Channel()
+    {
+        profiledMutexDestroy(&lock);
+    }
+
+    void push(const T &item)
+    {
+        profiledLock(&lock);
+        if (waiters.empty())
+        {
+            items.push_back(item);
+            profiledUnlock(&lock);
+            return;
+        }
+        Waiter waiter = waiters.front();
+        waiters.pop_front();
+        *waiter.slot = item;
+        profiledUnlock(&lock);
+        executor.schedule(waiter.handle);
+    }
+
+    void close()
+    {
+        profiledLock(&lock);
+        closed = true;
+        deque<Waiter> woken;
+        woken.swap(waiters);
+        profiledUnlock(&lock);
+        for (const Waiter &waiter : woken)
+        {
+            executor.schedule(waiter.handle);
+        }
+    }
+
+    struct PopAwaiter
+    {
+        Channel *channel;
+        optional<T> result;
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            ProfiledMutex *lock = &channel->lock;
+            profiledLock(lock);
+            if (!channel->items.empty())
+            {
+                result = channel->items.front();
+                channel->items.pop_front();
+                profiledUnlock(lock);
+                return false;
+            }
+            if (channel->closed)
+            {
+                profiledUnlock(lock);
+                return false;
+            }
+            channel->waiters.push_back(Waiter{handle, &result});
+            profiledUnlock(lock);
+            return true;
+        }
+
+        optional<T> await_resume() { return move(result); }
+    };
+
+    PopAwaiter pop() { return PopAwaiter{this, nullopt}; }
+
+private:
+    struct Waiter
+    {
+        coroutine_handle<> handle;
+        optional<T> *slot;
+    };
+
+    Executor &executor;
+    ProfiledMutex lock;
+    deque<T> items;
+    deque<Waiter> waiters;
+    bool closed;
+};
+
+// The oven for coroutine bakers. An order's breads go in as batches that share one
+// readyAt, so the oven keeps batches rather than single breads. reserve() hands out
+// free slots to waiting bakers in config.admission order. Completions count the breads of each
+// baker's order in this oven only; a baker that split its order waits on every oven it used.
+class CoroOven
+{
+public:
+    CoroOven(Executor &executor, int capacity, int bakingTime, AdmissionPolicy admission, int bakerCount)
+        : executor(executor), capacity(capacity), freeSlots(capacity), bakingTime(bakingTime * NANOS_PER_SEC),
+          bakersWorking(bakerCount), baked(0), slotWaiters(bakerCount), ovenWaiter(nullptr), completions(bakerCount)
+    {
+        this->admission.init(admission, bakerCount, this->bakingTime);
+        profiledMutexInit(&lock, LockName::CoroOven);
+    }
+
+    ~CoroOven()
+    {
+        profiledMutexDestroy(&lock);
+    }
+
+    // co_await reserve(...): waits while the oven is full or its turn has not come, then
+    // yields 1..count reserved slots.
+    struct ReserveAwaiter
+    {
+        CoroOven *oven;
+        int bakerIndex;
+        int count;
+        int firstIndex;
+        long long orderPlacedAt;
+        int granted;
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            ProfiledMutex *lock = &oven->lock;
+            profiledLock(lock);
+            int free = oven->freeSlots.load(memory_order_relaxed);
+            if (free > 0 && oven->admission.empty())
+            {
+                granted = min(free, count);
+                oven->freeSlots.store(free - granted, memory_order_relaxed);
+                profiledUnlock(lock);
+                return false;
+            }
+            oven->admission.add(bakerIndex, count, firstIndex, orderPlacedAt);
+            oven->slotWaiters[bakerIndex] = SlotWaiter{handle, &granted};
+            profiledUnlock(lock);
+            return true;
+        }
+
+        int await_resume() const { return granted; }
+    };
+
+    // Breads firstIndex.. of the baker's order, placed at orderPlacedAt, want `count` slots.
+    ReserveAwaiter reserve(int bakerIndex, int count, int firstIndex, long long orderPlacedAt)
+    {
+        return ReserveAwaiter{this, bakerIndex, count, firstIndex, orderPlacedAt, 0};
+    }
+
+    // Occupied fraction, for chooseOven().
+    double load() const { return (double)occupancy() / capacity; }
+    int occupancy() const { return capacity - freeSlots.load(memory_order_relaxed); }
+
+    // Breads taken out so far.
+    long long bakedBreads() const { return baked.load(memory_order_relaxed); }
+
+    // Puts `count` reserved breads of the baker's order in; returns the insertion time.
+    long long insert(int bakerIndex, uint32_t customerId, int count)
+    {
+        profiledLock(&lock);
+        completions[bakerIndex].remainingBreads += count;
+        long long insertedAt = clockNow();
+        Batch batch{insertedAt + bakingTime, customerId, bakerIndex, count};
+        coroutine_handle<> woken = ovenWaiter;
+        if (woken)
+        {
+            ovenWaiter = nullptr;
+            *ovenSlot = batch;
+        }
+        else
+        {
+            batches.push_back(batch);
+        }
+        profiledUnlock(&lock);
+        if (woken)
+        {
+            executor.schedule(woken);
+        }
+        return insertedAt;
+    }
+
+    // co_await orderDone(bakerIndex): waits for the last bread of the baker's order; yields its time.
+    struct OrderDoneAwaiter
+    {
+        CoroOven *oven;
+        int bakerIndex;
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            ProfiledMutex *lock = &oven->lock;
+            profiledLock(lock);
+            Completion &completion = oven->completions[bakerIndex];
+            if (completion.remainingBreads == 0)
+            {
+                profiledUnlock(lock);
+                return false;
+            }
+            completion.waiter = handle;
+            profiledUnlock(lock);
+            return true;
+        }
+
+        long long await_resume() const { return oven->completions[bakerIndex].lastBreadOutAt; }
+    };
+
+    OrderDoneAwaiter orderDone(int bakerIndex) { return OrderDoneAwaiter{this, bakerIndex}; }
+
+    void bakerFinished()
+    {
+        profiledLock(&lock);
+        coroutine_handle<> woken = nullptr;
+        if (--bakersWorking == 0)
+        {
+            woken = ovenWaiter;
+            ovenWaiter = nullptr;
+        }
+        profiledUnlock(&lock);
+        if (woken)
+        {
+            executor.schedule(woken);
+        }
+    }
+
+    // Oven coroutine body: takes batches out as they are baked until every baker has finished.
+    Task run(int ovenIndex)
+    {
+        logEvent(LogLevel::Info, EventType::ActorStart, ActorKind::Oven, ovenIndex);
+        while (true)
+        {
+            optional<Batch> batch = co_await NextBatchAwaiter{this, nullopt};
+            if (!batch)
+            {
+                break;
+            }
+            if (clockNow() < batch->readyAt)
+            {
+                co_await executor.sleepUntil(batch->readyAt);
+            }
+            takeOut(*batch);
+            logEvent(LogLevel::Trace, EventType::BreadsOut, ActorKind::Oven, ovenIndex, batch->customerId, batch->count, batch->bakerIndex);
+        }
+        logEvent(LogLevel::Info, EventType::ActorEnd, ActorKind::Oven, ovenIndex);
+    }
+
+private:
+    struct Batch
+    {
+        long long readyAt;
+        uint32_t customerId;
+        int bakerIndex;
+        int count;
+    };
+
+    struct SlotWaiter
+    {
+        coroutine_handle<> handle;
+        int *granted;
+    };
+
+    struct Completion
+    {
+        int remainingBreads = 0;
+        long long lastBreadOutAt = 0;
+        coroutine_handle<> waiter = nullptr;
+    };
+
+    // Yields the oldest batch, or nullopt once the oven is empty and every baker has finished.
+    struct NextBatchAwaiter
+    {
+        CoroOven *oven;
+        optional<Batch> result;
+
+        bool await_ready() const { return false; }
+
+        bool await_suspend(coroutine_handle<> handle)
+        {
+            ProfiledMutex *lock = &oven->lock;
+            profiledLock(lock);
+            if (!oven->batches.empty())
+            {
+                result = oven->batches.front();
+                oven->batches.pop_front();
+                profiledUnlock(lock);
+                return false;
+            }
+            if (oven->bakersWorking == 0)
+            {
+                profiledUnlock(lock);
+                return false;
+            }
+            oven->ovenWaiter = handle;
+            oven->ovenSlot = &result;
+            profiledUnlock(lock);
+            return true;
+        }
+
+        optional<Batch> await_resume() { return move(result); }
+    };
+
+    void takeOut(const Batch &batch)
+    {
+        vector<coroutine_handle<>> woken;
+        profiledLock(&lock);
+        int free = freeSlots.load(memory_order_relaxed) + batch.count;
+        baked.store(baked.load(memory_order_relaxed) + batch.count, memory_order_relaxed);
+        while (free > 0 && !admission.empty())
+        {
+            const AdmissionScheduler::Request &next = admission.front();
+            SlotWaiter &waiter = slotWaiters[next.bakerIndex];
+            *waiter.granted = min(free, next.count);
+            free -= *waiter.granted;
+            woken.push_back(waiter.handle);
+            admission.pop(*waiter.granted);
+        }
+        freeSlots.store(free, memory_order_relaxed);
+        Completion &completion = completions[batch.bakerIndex];
+        completion.remainingBreads -= batch.count;
+        if (completion.remainingBreads == 0)
+        {
+            completion.lastBreadOutAt = clockNow();
+            if (completion.waiter)
+            {
+                woken.push_back(completion.waiter);
+                completion.waiter = nullptr;
+            }
+        }
+        profiledUnlock(&lock);
+        for (coroutine_handle<> handle : woken)
+        {
+            executor.schedule(handle);
+        }
+    }
+
+    Executor &executor;
+    ProfiledMutex lock;
+    int capacity;
+    atomic<int> freeSlots; // changed under lock, read without it
+    long long bakingTime;
+    int bakersWorking;
+    atomic<long long> baked; // changed under lock, read without it
+    AdmissionScheduler admission;
+    vector<SlotWaiter> slotWaiters; // by baker, for the requests queued in admission
+    deque<Batch> batches;
+    coroutine_handle<> ovenWaiter;
+    optional<Batch> *ovenSlot;
+    vector<Completion> completions;
+};
+
+// Per-baker queues of the coroutine backend.
+struct CoroStation
+{
+    explicit CoroStation(Executor &executor) : requests(executor), deliveries(executor), openCustomers(1) {}
+
+    Channel<Order> requests;
+    Channel<Order> deliveries;
+    atomic<int> openCustomers; // like Bakery::openCustomers; the queue closes when it reaches 0
+};
+
+struct CoroEngine
+{
+    CoroEngine(Bakery &bakery, bool orderlyQueues)
+        : bakery(bakery), orderlyQueues(orderlyQueues)
+    {
+        for (const OvenConfig &oven : bakery.config.ovens)
+        {
+            ovens.emplace_back(executor, oven.capacity, oven.bakingTime, bakery.config.admission, bakery.config.bakerCount);
+        }
+        for (int i = 0; i < bakery.config.bakerCount; i++)
+        {
+            stations.emplace_back(executor);
+        }
+    }
+
+    Bakery &bakery;
+    Executor executor;
+    deque<CoroOven> ovens;
+    deque<CoroStation> stations;
+    bool orderlyQueues;
+};
+
+static void customerDoneOrdering(CoroStation &station)
+{
+    if (station.openCustomers.fetch_sub(1) == 1)
+    {
+        station.requests.close();
+    }
+}
+
+static void placeOrder(CoroEngine &engine, Order order)
+{
+    orderPlaced(engine.bakery, order);
+    engine.stations[order.bakerIndex].requests.push(order);
+}
+
+static Task baker(CoroEngine &engine, int bakerIndex)
+{
+    CoroStation &station = engine.stations[bakerIndex];
+    logEvent(LogLevel::Info, EventType::ActorStart, ActorKind::Baker, bakerIndex);
+    uint32_t ovenSeed = bakerIndex + 1;
+    auto ovenLoad = [&engine](int i) { return engine.ovens[i].load(); };
+    vector<bool> usedOvens(engine.ovens.size());
+    while (true)
+    {
+        // ------ Receive order --------
+        optional<Order> next = co_await station.requests.pop();
+        if (!next)
+        {
+            break;
+        }
+        Order req = *next;
+        orderTaken(engine.bakery, bakerIndex, req);
+        // ------ End Receive order --------
+
+        // ------ Baking on the oven --------
+        for (int inserted = 0; inserted < req.breadCount;)
+        {
+            int ovenIndex = chooseOven(engine.bakery.config, bakerIndex, ovenSeed, ovenLoad);
+            CoroOven &oven = engine.ovens[ovenIndex];
+            int batch = co_await oven.reserve(bakerIndex, req.breadCount - inserted, inserted, req.timestamps.enqueuedAt);
+            long long insertedAt = oven.insert(bakerIndex, req.customerId, batch);
+            logEvent(LogLevel::Trace, EventType::BreadsIn, ActorKind::Baker, bakerIndex, req.customerId, batch, ovenIndex, req.orderId);
+            usedOvens[ovenIndex] = true;
+            if (inserted == 0)
+            {
+                req.timestamps.firstBreadInAt = insertedAt;
+                req.firstOven = ovenIndex;
+            }
+            inserted += batch;
+        }
+        req.timestamps.lastBreadOutAt = 0;
+        for (size_t i = 0; i < usedOvens.size(); i++)
+        {
+            if (usedOvens[i])
+            {
+                long long lastBreadOutAt = co_await engine.ovens[i].orderDone(bakerIndex);
+                req.timestamps.lastBreadOutAt = max(req.timestamps.lastBreadOutAt, lastBreadOutAt);
+                usedOvens[i] = false;
+            }
+        }
+        logEvent(LogLevel::Debug, EventType::OrderBaked, ActorKind::Baker, bakerIndex, req.customerId, req.breadCount, 0, req.orderId);
+        // ------ End baking on the oven --------
+
+        // ------ Delivery to customer --------
+        station.deliveries.push(req);
+        orderHandedOver(engine.bakery, bakerIndex, req);
+        // ------ End Delivery to customer --------
+    }
+    logEvent(LogLevel::Info, EventType::ActorEnd, ActorKind::Baker, bakerIndex);
+    for (CoroOven &oven : engine.ovens)
+    {
+        oven.bakerFinished();
+    }
+}
+
+// One customer with one order: the open-loop and chaos customers.
+static Task orderingCustomer(CoroEngine &engine, Order order)
+{
+    CoroStation &station = engine.stations[order.bakerIndex];
+    placeOrder(engine, order);
+    customerDoneOrdering(station);
+    optional<Order> delivered = co_await station.deliveries.pop();
+    orderDelivered(engine.bakery, *delivered);
+}
+
+// Feeds one queue from bakery.orders. Orderly closed-loop queues send one order at a time;
+// otherwise every order becomes its own customer coroutine once it arrives.
+static Task queueAgent(CoroEngine &engine, int bakerIndex)
+{
+    CoroStation &station = engine.stations[bakerIndex];
+    OrderSource &source = *engine.bakery.orders;
+    bool oneAtATime = engine.orderlyQueues && source.closedLoop();
+
+    OrderSpec next;
+    while (source.next(bakerIndex, next))
+    {
+        Order order;
+        order.customerId = next.customerId;
+        order.breadCount = next.breadCount;
+        order.bakerIndex = bakerIndex;
+
+        if (oneAtATime)
+        {
+            if (next.thinkTime > 0)
+            {
+                co_await engine.executor.sleepUntil(clockNow() + next.thinkTime);
+            }
+            placeOrder(engine, order);
+            optional<Order> delivered = co_await station.deliveries.pop();
+            orderDelivered(engine.bakery, *delivered);
+            continue;
+        }
+
+        if (!source.closedLoop() && clockNow() < next.arrivalAt)
+        {
+            co_await engine.executor.sleepUntil(next.arrivalAt);
+        }
+        station.openCustomers.fetch_add(1);
+        engine.executor.spawn(orderingCustomer(engine, order));
+    }
+    customerDoneOrdering(station);
+}
+
+void runCoroutines(Bakery &bakery, BakeryMode &mode)
+{
+    CoroEngine engine(bakery, mode.orderlyQueues());
+    statsStart(bakery, [&engine](int i) { return OvenGauge{engine.ovens[i].occupancy(), engine.ovens[i].bakedBreads()}; });
+    for (int i = 0; i < bakery.config.bakerCount; i++)
+    {
+        engine.executor.spawn(baker(engine, i));
+        engine.executor.spawn(queueAgent(engine, i));
+    }
+    for (size_t i = 0; i < engine.ovens.size(); i++)
+    {
+        engine.executor.spawn(engine.ovens[i].run(i));
+    }
+
+    engine.executor.run(max(1u, thread::hardware_concurrency()));
+    statsStop();
+    for (size_t i = 0; i < engine.ovens.size(); i++)
+    {
+        bakery.metrics.recordOvenBreads(i, engine.ovens[i].bakedBreads());
+    }
+}
@@ -0,0 +1,145 @@
+#include "bakery.h"
+
+using namespace std;
+
+void DeliveryChannel::init(bool multiProducer, bool multiConsumer)
+{
+    head.store(0);
+    tail.store(0);
+    sleepingConsumers.store(0);
+    sleepingProducers.store(0);
+    this->multiProducer = multiProducer;
+    this->multiConsumer = multiConsumer;
+    profiledMutexInit(&producerLock, LockName::DeliveryProducer);
+    profiledMutexInit(&consumerLock, LockName::DeliveryConsumer);
+    profiledMutexInit(&waitLock, LockName::DeliveryWait);
+    clockCondInit(&notEmpty);
+    clockCondInit(&notFull);
+}
+
+void DeliveryChannel::destroy()
+{
+    profiledMutexDestroy(&producerLock);
+    profiledMutexDestroy(&consumerLock);
+    profiledMutexDestroy(&waitLock);
+    clockCondDestroy(&notEmpty);
+    clockCondDestroy(&notFull);
+}
+
+bool DeliveryChannel::empty() const
+{
+    return tail.load(memory_order_seq_cst) == head.load(memory_order_seq_cst);
+}
+
+void DeliveryChannel::push(const Order &order)
+{
+    while (true)
+    {
+        if (multiProducer)
+        {
+            profiledLock(&producerLock);
+        }
+        unsigned long long position = tail.load(memory_order_relaxed);
+        bool room = position - head.load(memory_order_acquire) < CAPACITY;
+        if (room)
+        {
+            slots[position % CAPACITY] = order;
+            tail.store(position + 1, memory_order_release);
+        }
+        if (multiProducer)
+        {
+            profiledUnlock(&producerLock);
+        }
+
+        if (room)
+        {
+            // Pairs with a consumer announcing itself in sleepingConsumers before re-checking.
+            atomic_thread_fence(memory_order_seq_cst);
+            if (sleepingConsumers.load(memory_order_relaxed) > 0)
+            {
+                profiledLock(&waitLock);
+                clockCondSignal(&notEmpty);
+                profiledUnlock(&waitLock);
+            }
+            return;
+        }
+
+        // Full: customers are behind on pickups.
+        profiledLock(&waitLock);
+        sleepingProducers.fetch_add(1, memory_order_seq_cst);
+        while (tail.load(memory_order_seq_cst) - head.load(memory_order_seq_cst) >= CAPACITY)
+        {
+            clockCondWait(&notFull, &waitLock);
+        }
+        sleepingProducers.fetch_sub(1, memory_order_relaxed);
+        profiledUnlock(&waitLock);
+    }
+}
+
+bool DeliveryChannel::tryPop(Order &order)
+{
+    if (multiConsumer)
+    {
+        profiledLock(&consumerLock);
+    }
+    unsigned long long position = head.load(memory_order_relaxed);
+    bool available = tail.load(memory_order_acquire) != position;
+    if (available)
+    {
+        order = slots[position % CAPACITY];
+        head.store(position + 1, memory_order_release);
+    }
+    if (multiConsumer)
+    {
+        profiledUnlock(&consumerLock);
+    }
+
+    if (available)
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleepingProducers.load(memory_order_relaxed) > 0)
+        {
+            profiledLock(&waitLock);
+            clockCondBroadcast(&notFull);
+            profiledUnlock(&waitLock);
+        }
+    }
+    return available;
+}
+
+Order DeliveryChannel::pop()
+{
+    Order order;
+    while (!tryPop(order))
+    {
+        profiledLock(&waitLock);
+        sleepingConsumers.fetch_add(1, memory_order_seq_cst);
+        while (empty())
+        {
+            clockCondWait(&notEmpty, &waitLock);
+        }
+        sleepingConsumers.fetch_sub(1, memory_order_relaxed);
+        profiledUnlock(&waitLock);
+    }
+    return order;
+}
+
+bool DeliveryChannel::popBefore(long long deadline, Order &order)
+{
+    while (!tryPop(order))
+    {
+        if (clockNow() >= deadline)
+        {
+            return false;
+        }
+        profiledLock(&waitLock);
+        sleepingConsumers.fetch_add(1, memory_order_seq_cst);
+        while (empty() && clockNow() < deadline)
+        {
+            clockCondTimedWait(&notEmpty, &waitLock, deadline);
+        }
+        sleepingConsumers.fetch_sub(1, memory_order_relaxed);
+        profiledUnlock(&waitLock);
+    }
+    return true;
+}
@@ -0,0 +1,622 @@
+#include "eventlog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <sched.h>
+#include <set>
+#include <vector>
+#include "pthread.h"
+#include "workload.h"
+
+using namespace std;
+
+LogLevel eventLogLevel = LogLevel::Off;
+
+// One producer (the owning thread), one consumer (the flusher).
+struct alignas(64) EventRing
+{
+    static const unsigned CAPACITY = 8192;
+
+    alignas(64) atomic<unsigned long long> head{0}; // flusher
+    alignas(64) atomic<unsigned long long> tail{0}; // owning thread
+    // Owning thread: the stamp of its previous event while it records the next one,
+    // LLONG_MAX between events. Nothing later than this can still be missing from the ring.
+    atomic<long long> recordingSince{LLONG_MAX};
+    long long lastAt = 0; // owning thread
+    uint32_t id;          // position in `rings`
+    LogEvent events[CAPACITY];
+};
+
+static LogFormat format;
+static FILE *sink;
+static const OrderSource *orderSource;
+
+// Rings of every thread that logged in the current run. A thread keeps its ring
+// after it exits, so nothing it recorded is lost; rings are freed by eventLogStop().
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<EventRing *> rings;
+static unsigned generation = 0; // bumped per run, so threads reused by a later run re-register
+
+static thread_local EventRing *threadRing = nullptr;
+static thread_local unsigned threadGeneration = 0;
+
+static atomic<bool> flusherStopping{false};
+static pthread_t flusherHandler;
+static bool flusherRunning = false;
+
+bool parseLogLevel(const string &name, LogLevel &level)
+{
+    if (name == "off")
+    {
+        level = LogLevel::Off;
+    }
+    else if (name == "info")
+    {
+        level = LogLevel::Info;
+    }
+    else if (name == "debug")
+    {
+        level = LogLevel::Debug;
+    }
+    else if (name == "trace")
+    {
+        level = LogLevel::Trace;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool parseLogFormat(const string &name, LogFormat &format)
+{
+    if (name == "text")
+    {
+        format = LogFormat::Text;
+    }
+    else if (name == "jsonl")
+    {
+        format = LogFormat::Jsonl;
+    }
+    else if (name == "binary")
+    {
+        format = LogFormat::Binary;
+    }
+    else if (name == "chrome")
+    {
+        format = LogFormat::Chrome;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static const char *actorName(ActorKind kind)
+{
+    switch (kind)
+    {
+    case ActorKind::Baker:
+        return "Baker";
+    case ActorKind::Oven:
+        return "Oven";
+    case ActorKind::Customer:
+        return "Customer";
+    case ActorKind::Clock:
+        return "Clock";
+    }
+    return "?";
+}
+
+static const char *eventName(EventType type)
+{
+    switch (type)
+    {
+    case EventType::ActorStart:
+        return "actor_start";
+    case EventType::ActorEnd:
+        return "actor_end";
+    case EventType::Tick:
+        return "tick";
+    case EventType::CustomerArrived:
+        return "customer_arrived";
+    case EventType::OrderPlaced:
+        return "order_placed";
+    case EventType::OrderTaken:
+        return "order_taken";
+    case EventType::OrderStolen:
+        return "order_stolen";
+    case EventType::BreadsIn:
+        return "breads_in";
+    case EventType::BreadsOut:
+        return "breads_out";
+    case EventType::OrderBaked:
+        return "order_baked";
+    case EventType::OrderHandedOver:
+        return "order_handed_over";
+    case EventType::OrderDelivered:
+        return "order_delivered";
+    }
+    return "?";
+}
+
+static bool hasCustomer(EventType type)
+{
+    return type != EventType::ActorStart && type != EventType::ActorEnd && type != EventType::Tick;
+}
+
+static void writeText(const LogEvent &event)
+{
+    string customer = hasCustomer(event.type) ? orderSource->customerName(event.customerId) : "";
+    const char *actor = actorName(event.actorKind);
+    switch (event.type)
+    {
+    case EventType::ActorStart:
+        fprintf(sink, "%s_%d starting...\n\n", actor, event.actor);
+        break;
+    case EventType::ActorEnd:
+        fprintf(sink, "%s_%d ending...\n", actor, event.actor);
+        break;
+    case EventType::Tick:
+        fprintf(sink, "Time elapsed: #%d seconds\n", event.value);
+        break;
+    case EventType::CustomerArrived:
+        fprintf(sink, "Customer_%s%d arrived.\n", customer.c_str(), event.actor);
+        break;
+    case EventType::OrderPlaced:
+        fprintf(sink, "Customer %s is ordering %d breads to baker #%d \n", customer.c_str(), event.value, event.actor);
+        break;
+    case EventType::OrderTaken:
+        fprintf(sink, "Baker_%d took the order of %s (%d breads)\n", event.actor, customer.c_str(), event.value);
+        break;
+    case EventType::OrderStolen:
+        fprintf(sink, "Baker_%d stole the order of %s from queue #%d\n", event.actor, customer.c_str(), event.value);
+        break;
+    case EventType::BreadsIn:
+        fprintf(sink, "Baker_%d : putting %d breads of %s in the oven\n", event.actor, event.value, customer.c_str());
+        break;
+    case EventType::BreadsOut:
+        fprintf(sink, "Oven_%d : %d breads of %s are out\n", event.actor, event.value, customer.c_str());
+        break;
+    case EventType::OrderBaked:
+        fprintf(sink, "Baker_%d : the %d breads of %s are baked\n", event.actor, event.value, customer.c_str());
+        break;
+    case EventType::OrderHandedOver:
+        fprintf(sink, "Baker_%d handed the order of %s over\n", event.actor, customer.c_str());
+        break;
+    case EventType::OrderDelivered:
+        fprintf(sink, "Customer: %s Received %d breads and is leaving...\n\n", customer.c_str(), event.value);
+        break;
+    }
+}
+
+// Customer names come from whitespace separated input, so only quotes and backslashes need escaping.
+static string jsonCustomerName(uint32_t customerId)
+{
+    string name;
+    for (char c : orderSource->customerName(customerId))
+    {
+        if (c == '"' || c == '\\')
+        {
+            name += '\\';
+        }
+        name += c;
+    }
+    return name;
+}
+
+static void writeJson(const LogEvent &event)
+{
+    fprintf(sink, "{\"t_ns\": %lld, \"event\": \"%s\", \"actor\": \"%s\", \"index\": %d", event.at, eventName(event.type),
+            actorName(event.actorKind), event.actor);
+    if (hasCustomer(event.type))
+    {
+        fprintf(sink, ", \"order_id\": %llu, \"customer_id\": %u, \"customer\": \"%s\"", (unsigned long long)event.orderId,
+                event.customerId, jsonCustomerName(event.customerId).c_str());
+    }
+    fprintf(sink, ", \"value\": %d, \"detail\": %d}\n", event.value, event.detail);
+}
+
+// ------ Chrome trace --------
+// One process holds a thread per baker, one a thread per customer queue, and every oven is a
+// process of its own. Bakers get nested duration events for their phases, orders and oven
+// batches get async spans, and each oven an occupancy counter. State is the flusher's own.
+
+static const int BAKERS_PID = 1;
+static const int CUSTOMERS_PID = 2;
+static const int FIRST_OVEN_PID = 3; // oven i is process FIRST_OVEN_PID + i
+
+// Breads one baker put in one oven at once, until the last of them is out.
+struct OvenBatch
+{
+    unsigned long long id;
+    uint32_t customerId;
+    int remaining;
+};
+
+static bool chromeFirstEvent;
+static set<pair<int, int>> chromeNamed;             // (pid, tid) with metadata written
+static vector<int> bakerBreadsToInsert;             // per baker, breads of its order not yet in
+static map<pair<int, int>, deque<OvenBatch>> ovenBatches; // per (oven, baker), in insertion order
+static vector<int> ovenOccupancy;
+static unsigned long long nextBatchId;
+
+static void chromeStart()
+{
+    chromeFirstEvent = true;
+    chromeNamed.clear();
+    bakerBreadsToInsert.clear();
+    ovenBatches.clear();
+    ovenOccupancy.clear();
+    nextBatchId = 0;
+    fprintf(sink, "{\"traceEvents\": [\n");
+}
+
+static void chromeStop()
+{
+    fprintf(sink, "\n]}\n");
+}
+
+// Writes one trace event; `fields` is the rest of the JSON object, starting with a comma.
+static void chromeEvent(const char *phase, int pid, int tid, long long at, const string &fields)
+{
+    fprintf(sink, "%s{\"ph\": \"%s\", \"pid\": %d, \"tid\": %d, \"ts\": %lld.%03lld%s}", chromeFirstEvent ? "" : ",\n",
+            phase, pid, tid, at / 1000, at % 1000, fields.c_str());
+    chromeFirstEvent = false;
+}
+
+static void chromeName(int pid, int tid, const string &process, const string &thread)
+{
+    if (chromeNamed.insert({pid, -1}).second)
+    {
+        chromeEvent("M", pid, 0, 0, ", \"name\": \"process_name\", \"args\": {\"name\": \"" + process + "\"}");
+        chromeEvent("M", pid, 0, 0, ", \"name\": \"process_sort_index\", \"args\": {\"sort_index\": " + to_string(pid) + "}");
+    }
+    if (chromeNamed.insert({pid, tid}).second)
+    {
+        chromeEvent("M", pid, tid, 0, ", \"name\": \"thread_name\", \"args\": {\"name\": \"" + thread + "\"}");
+    }
+}
+
+static void chromeBegin(int tid, long long at, const string &name)
+{
+    chromeEvent("B", BAKERS_PID, tid, at, ", \"name\": \"" + name + "\"");
+}
+
+static void chromeEnd(int tid, long long at)
+{
+    chromeEvent("E", BAKERS_PID, tid, at, "");
+}
+
+static void chromeOvenLoad(int oven, long long at, int breads)
+{
+    if ((int)ovenOccupancy.size() <= oven)
+    {
+        ovenOccupancy.resize(oven + 1, 0);
+    }
+    ovenOccupancy[oven] += breads;
+    chromeEvent("C", FIRST_OVEN_PID + oven, 0, at,
+                ", \"name\": \"occupancy\", \"args\": {\"breads\": " + to_string(ovenOccupancy[oven]) + "}");
+}
+
+static void writeChrome(const LogEvent &event)
+{
+    string customer = hasCustomer(event.type) ? jsonCustomerName(event.customerId) : "";
+    string index = to_string(event.actor);
+    switch (event.actorKind)
+    {
+    case ActorKind::Baker:
+        chromeName(BAKERS_PID, event.actor, "bakers", "Baker_" + index);
+        if ((int)bakerBreadsToInsert.size() <= event.actor)
+        {
+            bakerBreadsToInsert.resize(event.actor + 1, 0);
+        }
+        break;
+    case ActorKind::Customer:
+        chromeName(CUSTOMERS_PID, event.actor, "customers", "Customer_" + index);
+        break;
+    case ActorKind::Oven:
+        chromeName(FIRST_OVEN_PID + event.actor, 0, "oven #" + index, "Oven_" + index);
+        break;
+    case ActorKind::Clock:
+        break;
+    }
+
+    // A baker's phases: waiting for an order, then inside "order of X" waiting for oven
+    // slots, waiting for the oven and handing the bread over.
+    long long at = event.at;
+    int baker = event.actor;
+    switch (event.type)
+    {
+    case EventType::ActorStart:
+        if (event.actorKind == ActorKind::Baker)
+        {
+            chromeBegin(baker, at, "waiting for an order");
+        }
+        break;
+    case EventType::ActorEnd:
+        if (event.actorKind == ActorKind::Baker)
+        {
+            chromeEnd(baker, at);
+        }
+        break;
+    case EventType::Tick:
+        break;
+    case EventType::CustomerArrived:
+        chromeEvent("i", CUSTOMERS_PID, event.actor, at, ", \"s\": \"t\", \"name\": \"" + customer + " arrived\"");
+        break;
+    case EventType::OrderPlaced:
+        chromeEvent("b", CUSTOMERS_PID, event.actor, at,
+                    ", \"cat\": \"order\", \"name\": \"" + customer + "\", \"id\": " + to_string(event.orderId) +
+                        ", \"args\": {\"breads\": " + to_string(event.value) + "}");
+        break;
+    case EventType::OrderDelivered:
+        chromeEvent("e", CUSTOMERS_PID, event.actor, at,
+                    ", \"cat\": \"order\", \"name\": \"" + customer + "\", \"id\": " + to_string(event.orderId));
+        break;
+    case EventType::OrderStolen:
+        chromeEvent("i", BAKERS_PID, baker, at, ", \"s\": \"t\", \"name\": \"stole from queue #" + to_string(event.value) + "\"");
+        break;
+    case EventType::OrderTaken:
+        chromeEnd(baker, at);
+        chromeBegin(baker, at, "order of " + customer);
+        chromeBegin(baker, at, "waiting for oven slots");
+        bakerBreadsToInsert[baker] = event.value;
+        break;
+    case EventType::BreadsIn:
+    {
+        chromeEnd(baker, at);
+        bakerBreadsToInsert[baker] -= event.value;
+        chromeBegin(baker, at, bakerBreadsToInsert[baker] > 0 ? "waiting for oven slots" : "waiting for the oven");
+
+        int oven = event.detail;
+        OvenBatch batch{nextBatchId++, event.customerId, event.value};
+        ovenBatches[{oven, baker}].push_back(batch);
+        chromeEvent("b", FIRST_OVEN_PID + oven, 0, at,
+                    ", \"cat\": \"breads\", \"name\": \"" + customer + "\", \"id\": " + to_string(batch.id) +
+                        ", \"args\": {\"breads\": " + to_string(event.value) + ", \"baker\": " + index + "}");
+        chromeOvenLoad(oven, at, event.value);
+        break;
+    }
+    case EventType::BreadsOut:
+    {
+        // Breads of one baker leave an oven in the order they went in, but not always in the
+        // same groups: close every batch the count covers.
+        int oven = event.actor;
+        deque<OvenBatch> &batches = ovenBatches[{oven, event.detail}];
+        for (int out = event.value; out > 0 && !batches.empty();)
+        {
+            OvenBatch &batch = batches.front();
+            int taken = min(out, batch.remaining);
+            batch.remaining -= taken;
+            out -= taken;
+            if (batch.remaining == 0)
+            {
+                chromeEvent("e", FIRST_OVEN_PID + oven, 0, at,
+                            ", \"cat\": \"breads\", \"name\": \"" + jsonCustomerName(batch.customerId) + "\", \"id\": " +
+                                to_string(batch.id));
+                batches.pop_front();
+            }
+        }
+        chromeOvenLoad(oven, at, -event.value);
+        break;
+    }
+    case EventType::OrderBaked:
+        chromeEnd(baker, at);
+        chromeBegin(baker, at, "handing over");
+        break;
+    case EventType::OrderHandedOver:
+        chromeEnd(baker, at);
+        chromeEnd(baker, at);
+        chromeBegin(baker, at, "waiting for an order");
+        break;
+    }
+}
+
+static void writeEvent(const LogEvent &event)
+{
+    if (format == LogFormat::Text)
+    {
+        writeText(event);
+    }
+    else if (format == LogFormat::Jsonl)
+    {
+        writeJson(event);
+    }
+    else if (format == LogFormat::Chrome)
+    {
+        writeChrome(event);
+    }
+    else
+    {
+        fwrite(&event, sizeof(event), 1, sink);
+    }
+}
+
+// Time order; events with the same clock reading by ring, then in the order they were recorded.
+static bool eventBefore(const LogEvent &a, const LogEvent &b)
+{
+    if (a.at != b.at)
+    {
+        return a.at < b.at;
+    }
+    return a.ring != b.ring ? a.ring < b.ring : a.seq < b.seq;
+}
+
+// Moves whatever the rings hold into `pending` and writes out, in time order, the events
+// stamped before the watermark; returns how many events it took from the rings. The watermark
+// is the clock now, or the previous stamp of a thread still recording an event if that is
+// earlier: every event before it is in `pending` by now, so a later call cannot bring up an
+// earlier event, and a bread never comes out of an oven before it went in. With `final` every
+// pending event is written.
+static long long drainRings(vector<LogEvent> &pending, bool final)
+{
+    long long watermark = clockNow();
+    pthread_mutex_lock(&registryLock);
+    vector<EventRing *> current = rings;
+    pthread_mutex_unlock(&registryLock);
+
+    size_t pendingBefore = pending.size();
+    for (EventRing *ring : current)
+    {
+        // Read before the tail: an event stamped after the clock reading above is either
+        // caught here or not written this time.
+        watermark = min(watermark, ring->recordingSince.load());
+        unsigned long long head = ring->head.load(memory_order_relaxed);
+        unsigned long long tail = ring->tail.load(memory_order_acquire);
+        for (; head != tail; head++)
+        {
+            pending.push_back(ring->events[head % EventRing::CAPACITY]);
+        }
+        ring->head.store(head, memory_order_release);
+    }
+    long long drained = pending.size() - pendingBefore;
+    // What was pending is sorted already: sort the new events alone and merge them in.
+    sort(pending.begin() + pendingBefore, pending.end(), eventBefore);
+    inplace_merge(pending.begin(), pending.begin() + pendingBefore, pending.end(), eventBefore);
+
+    size_t written = 0;
+    while (written < pending.size() && (final || pending[written].at < watermark))
+    {
+        writeEvent(pending[written++]);
+    }
+    pending.erase(pending.begin(), pending.begin() + written);
+    return drained;
+}
+
+// Not a clock actor: it runs on the wall clock in real and virtual time alike.
+static void *flusher(void *arg)
+{
+    vector<LogEvent> pending;
+    while (true)
+    {
+        bool stopping = flusherStopping.load(memory_order_acquire);
+        long long drained = drainRings(pending, stopping);
+        if (stopping)
+        {
+            break;
+        }
+        if (drained == 0)
+        {
+            fflush(sink);
+            timespec pause{0, 1000000};
+            nanosleep(&pause, nullptr);
+        }
+    }
+    return nullptr;
+}
+
+void eventLogStart(const LogConfig &config, const OrderSource *orders)
+{
+    eventLogLevel = config.level;
+    if (config.level == LogLevel::Off)
+    {
+        return;
+    }
+    if (config.format == LogFormat::Chrome)
+    {
+        eventLogLevel = LogLevel::Trace;
+    }
+
+    format = config.format;
+    orderSource = orders;
+    cout.flush();
+    sink = stdout;
+    if (!config.path.empty())
+    {
+        sink = fopen(config.path.c_str(), format == LogFormat::Binary ? "wb" : "w");
+        if (sink == nullptr)
+        {
+            cerr << "cannot open log file " << config.path << ". exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (format == LogFormat::Binary)
+    {
+        LogFileHeader header{};
+        memcpy(header.magic, "BAKELOG1", sizeof(header.magic));
+        header.eventSize = sizeof(LogEvent);
+        fwrite(&header, sizeof(header), 1, sink);
+    }
+    else if (format == LogFormat::Chrome)
+    {
+        chromeStart();
+    }
+
+    pthread_mutex_lock(&registryLock);
+    generation++;
+    pthread_mutex_unlock(&registryLock);
+    flusherStopping.store(false);
+    pthread_create(&flusherHandler, nullptr, &flusher, nullptr);
+    flusherRunning = true;
+}
+
+void eventLogStop()
+{
+    if (flusherRunning)
+    {
+        flusherStopping.store(true, memory_order_release);
+        pthread_join(flusherHandler, nullptr);
+        flusherRunning = false;
+        if (format == LogFormat::Chrome)
+        {
+            chromeStop();
+        }
+        fflush(sink);
+        if (sink != stdout)
+        {
+            fclose(sink);
+        }
+        sink = nullptr;
+    }
+
+    pthread_mutex_lock(&registryLock);
+    for (EventRing *ring : rings)
+    {
+        delete ring;
+    }
+    rings.clear();
+    pthread_mutex_unlock(&registryLock);
+    eventLogLevel = LogLevel::Off;
+}
+
+void eventLogRecord(LogEvent event)
+{
+    if (threadRing == nullptr || threadGeneration != generation)
+    {
+        threadRing = new EventRing();
+        pthread_mutex_lock(&registryLock);
+        threadGeneration = generation;
+        threadRing->id = rings.size();
+        rings.push_back(threadRing);
+        pthread_mutex_unlock(&registryLock);
+    }
+
+    EventRing &ring = *threadRing;
+    unsigned long long tail = ring.tail.load(memory_order_relaxed);
+    // Full: the flusher is behind. Wait rather than drop, so the log stays complete.
+    while (tail - ring.head.load(memory_order_acquire) >= EventRing::CAPACITY)
+    {
+        sched_yield();
+    }
+    // Publish a stamp no later than this event's before reading the clock, so the flusher
+    // holds back anything stamped later until this event is in the ring.
+    ring.recordingSince.store(ring.lastAt);
+    event.at = clockNow();
+    event.seq = tail;
+    event.ring = ring.id;
+    ring.lastAt = event.at;
+    ring.events[tail % EventRing::CAPACITY] = event;
+    ring.tail.store(tail + 1, memory_order_release);
+    ring.recordingSince.store(LLONG_MAX, memory_order_release);
+}
@@ -0,0 +1,111 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "sim_clock.h"
+
+class OrderSource;
+
+// Asynchronous event log. Actors record small binary events into a ring buffer of
+// their own thread without taking any lock; a background thread drains the rings and
+// formats them into the sink, so printing never serializes the simulation.
+
+enum class LogLevel : uint8_t
+{
+    Off,
+    Info,  // actors starting and ending, elapsed seconds
+    Debug, // every order: placed, taken, baked, delivered
+    Trace, // every batch of breads put in and taken out of an oven, every hand-over
+};
+
+enum class LogFormat : uint8_t
+{
+    Text,   // the bakery's narration, one line per event
+    Jsonl,  // one JSON object per line
+    Binary, // a LogFileHeader followed by raw LogEvent records
+    Chrome, // Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev
+};
+
+enum class EventType : uint16_t
+{
+    ActorStart,
+    ActorEnd,
+    Tick,            // value: elapsed seconds
+    CustomerArrived, // chaos customers coming through the door
+    OrderPlaced,     // value: breads
+    OrderTaken,      // value: breads
+    OrderStolen,     // value: queue the order was taken from
+    BreadsIn,        // value: breads put in the oven in one go; detail: oven
+    BreadsOut,       // value: breads of one baker taken out together; detail: baker
+    OrderBaked,      // value: breads
+    OrderHandedOver, // value: breads; the baker is free for the next order
+    OrderDelivered,  // value: breads
+};
+
+enum class ActorKind : uint8_t
+{
+    Baker,
+    Oven,
+    Customer, // a queue's ordering agent, or a chaos customer of that queue
+    Clock,
+};
+
+struct LogConfig
+{
+    LogLevel level;
+    LogFormat format;
+    std::string path; // empty: stdout
+};
+
+struct LogEvent
+{
+    long long at;  // clockNow()
+    uint64_t seq;  // record order within the recording thread
+    uint64_t orderId; // the order the event is about, if any
+    uint32_t customerId;
+    int32_t value;  // see EventType
+    int32_t detail; // see EventType
+    int32_t actor;  // baker, oven or queue index
+    uint32_t ring;  // the recording thread's ring; with `seq`, breaks ties between equal `at`
+    EventType type;
+    ActorKind actorKind;
+    uint8_t reserved[1];
+};
+
+static_assert(sizeof(LogEvent) == 48 && std::is_trivially_copyable_v<LogEvent>, "LogEvent is written to disk as is");
+
+// Start of a binary log; the file is native-endian.
+struct LogFileHeader
+{
+    char magic[8];      // "BAKELOG1"
+    uint32_t eventSize; // sizeof(LogEvent)
+    uint32_t reserved;
+};
+
+// Parse the --log-level / --log-format names; false for anything else.
+bool parseLogLevel(const std::string &name, LogLevel &level);
+bool parseLogFormat(const std::string &name, LogFormat &format);
+
+// Opens the sink and starts the flusher; `orders` names customers in the output and must
+// outlive eventLogStop(). A Chrome trace pairs up every event, so unless logging is off it
+// records at trace level. Exits on a sink that cannot be opened.
+void eventLogStart(const LogConfig &config, const OrderSource *orders);
+// Writes out everything recorded so far and closes the sink. Every actor must be done.
+void eventLogStop();
+
+extern LogLevel eventLogLevel;
+// Stamps `at`, `seq` and `ring` and queues the event for the flusher.
+void eventLogRecord(LogEvent event);
+
+inline void logEvent(LogLevel level, EventType type, ActorKind actorKind, int actor, uint32_t customerId = 0, int value = 0,
+                     int detail = 0, uint64_t orderId = 0)
+{
+    if (eventLogLevel >= level)
+    {
+        eventLogRecord(LogEvent{0, 0, orderId, customerId, value, detail, actor, 0, type, actorKind, {}});
+    }
+}
+
+#endif
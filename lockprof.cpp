@@ -0,0 +1,228 @@
+#include "lockprof.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include "metrics.h"
+
+using namespace std;
+
+bool lockProfiling = false;
+
+static const int BUCKETS = 48; // bucket k: [2^k, 2^(k+1)) nanoseconds
+
+struct LockCounters
+{
+    long long acquires;
+    long long contended;
+    long long condWaits;
+    long long waitNanos;
+    long long holdNanos;
+    long long waitBuckets[BUCKETS];
+    long long holdBuckets[BUCKETS];
+};
+
+// One per thread that took a profiled lock; written by that thread only.
+struct ThreadLockCounters
+{
+    LockCounters locks[(int)LockName::Count];
+};
+
+static const char *const lockNames[] = {
+    "request queue", "delivery producer", "delivery consumer", "delivery wait", "oven", "order completion",
+    "chaos pool", "metrics", "coro executor", "coro channel", "coro oven", "virtual clock", "order file",
+};
+
+static_assert(sizeof(lockNames) / sizeof(lockNames[0]) == (size_t)LockName::Count, "one name per LockName");
+
+// Tables of every thread that took a profiled lock since lockProfileStart(). Like the event
+// log's rings they outlive their threads and are freed by the next start.
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<ThreadLockCounters *> tables;
+static unsigned generation = 0;
+
+static thread_local ThreadLockCounters *threadTable = nullptr;
+static thread_local unsigned threadGeneration = 0;
+
+static long long monotonicNow()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOS_PER_SEC + now.tv_nsec;
+}
+
+static int bucketOf(long long nanoseconds)
+{
+    int bucket = 0;
+    while (nanoseconds > 1 && bucket < BUCKETS - 1)
+    {
+        nanoseconds >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static LockCounters &countersOf(const ProfiledMutex *mutex)
+{
+    if (threadTable == nullptr || threadGeneration != generation)
+    {
+        threadTable = new ThreadLockCounters();
+        pthread_mutex_lock(&registryLock);
+        threadGeneration = generation;
+        tables.push_back(threadTable);
+        pthread_mutex_unlock(&registryLock);
+    }
+    return threadTable->locks[(int)mutex->name];
+}
+
+void profiledMutexInit(ProfiledMutex *mutex, LockName name)
+{
+    pthread_mutex_init(&mutex->mutex, nullptr);
+    mutex->name = name;
+    mutex->acquiredAt = 0;
+}
+
+void profiledMutexDestroy(ProfiledMutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+}
+
+// Uncontended acquisitions cost a trylock and one clock read.
+void lockProfiledAcquire(ProfiledMutex *mutex)
+{
+    LockCounters &counters = countersOf(mutex);
+    counters.acquires++;
+    if (pthread_mutex_trylock(&mutex->mutex) == 0)
+    {
+        mutex->acquiredAt = monotonicNow();
+        return;
+    }
+
+    long long waitStart = monotonicNow();
+    pthread_mutex_lock(&mutex->mutex);
+    long long acquiredAt = monotonicNow();
+    counters.contended++;
+    counters.waitNanos += acquiredAt - waitStart;
+    counters.waitBuckets[bucketOf(acquiredAt - waitStart)]++;
+    mutex->acquiredAt = acquiredAt;
+}
+
+void lockProfiledRelease(ProfiledMutex *mutex)
+{
+    long long held = monotonicNow() - mutex->acquiredAt;
+    pthread_mutex_unlock(&mutex->mutex);
+    LockCounters &counters = countersOf(mutex);
+    counters.holdNanos += held;
+    counters.holdBuckets[bucketOf(held)]++;
+}
+
+void lockProfiledSleep(ProfiledMutex *mutex)
+{
+    long long held = monotonicNow() - mutex->acquiredAt;
+    LockCounters &counters = countersOf(mutex);
+    counters.condWaits++;
+    counters.holdNanos += held;
+    counters.holdBuckets[bucketOf(held)]++;
+}
+
+void lockProfiledWake(ProfiledMutex *mutex)
+{
+    mutex->acquiredAt = monotonicNow();
+}
+
+void lockProfileStart()
+{
+    pthread_mutex_lock(&registryLock);
+    for (ThreadLockCounters *table : tables)
+    {
+        delete table;
+    }
+    tables.clear();
+    generation++;
+    pthread_mutex_unlock(&registryLock);
+    lockProfiling = true;
+}
+
+void lockProfileStop()
+{
+    lockProfiling = false;
+}
+
+// Upper bound of the bucket holding the sample at `fraction` of the way up.
+static long long bucketPercentile(const long long *buckets, long long count, double fraction)
+{
+    long long rank = max(1LL, (long long)(fraction * count + 0.999999));
+    long long seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank)
+        {
+            return 1LL << (bucket + 1);
+        }
+    }
+    return 0;
+}
+
+vector<LockSummary> lockProfileSummary()
+{
+    LockCounters totals[(int)LockName::Count] = {};
+    pthread_mutex_lock(&registryLock);
+    for (const ThreadLockCounters *table : tables)
+    {
+        for (int lock = 0; lock < (int)LockName::Count; lock++)
+        {
+            const LockCounters &counters = table->locks[lock];
+            LockCounters &total = totals[lock];
+            total.acquires += counters.acquires;
+            total.contended += counters.contended;
+            total.condWaits += counters.condWaits;
+            total.waitNanos += counters.waitNanos;
+            total.holdNanos += counters.holdNanos;
+            for (int bucket = 0; bucket < BUCKETS; bucket++)
+            {
+                total.waitBuckets[bucket] += counters.waitBuckets[bucket];
+                total.holdBuckets[bucket] += counters.holdBuckets[bucket];
+            }
+        }
+    }
+    pthread_mutex_unlock(&registryLock);
+
+    vector<LockSummary> summary;
+    for (int lock = 0; lock < (int)LockName::Count; lock++)
+    {
+        const LockCounters &total = totals[lock];
+        if (total.acquires == 0)
+        {
+            continue;
+        }
+        // Every hold ends in a release or a ClockCond wait.
+        long long holds = total.acquires + total.condWaits;
+        summary.push_back(LockSummary{lockNames[lock], total.acquires, total.contended, total.condWaits, total.waitNanos,
+                                      total.holdNanos, bucketPercentile(total.waitBuckets, total.contended, 0.50),
+                                      bucketPercentile(total.waitBuckets, total.contended, 0.99),
+                                      bucketPercentile(total.holdBuckets, holds, 0.99)});
+    }
+    sort(summary.begin(), summary.end(), [](const LockSummary &a, const LockSummary &b) { return a.waitNanos > b.waitNanos; });
+    return summary;
+}
+
+void lockProfileReport(ostream &out)
+{
+    out << "\n==== Lock contention (wall clock, most total wait first) ====\n";
+    char row[256];
+    snprintf(row, sizeof(row), "%-18s %10s %10s %12s %12s %12s %12s %12s %10s\n", "lock", "acquires", "contended",
+             "wait total", "wait p50", "wait p99", "hold mean", "hold p99", "cond waits");
+    out << row;
+    for (const LockSummary &lock : lockProfileSummary())
+    {
+        long long holds = lock.acquires + lock.condWaits;
+        snprintf(row, sizeof(row), "%-18s %10lld %10lld %12s %12s %12s %12s %12s %10lld\n", lock.name, lock.acquires,
+                 lock.contended, formatDuration(lock.waitNanos).c_str(),
+                 lock.contended > 0 ? ("<" + formatDuration(lock.waitP50)).c_str() : "-",
+                 lock.contended > 0 ? ("<" + formatDuration(lock.waitP99)).c_str() : "-",
+                 formatDuration((double)lock.holdNanos / holds).c_str(), ("<" + formatDuration(lock.holdP99)).c_str(),
+                 lock.condWaits);
+        out << row;
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "pthread.h"
+#include "sim_clock.h"
+
+// Lock contention profiler. The simulation's mutexes are ProfiledMutexes, each named after
+// the role it plays; while profiling is on, every acquisition counts toward its name: how
+// often it was taken, how often it had to wait, and log2 histograms of wait and hold times
+// on the wall clock. Counters are kept per thread, so profiling adds no shared writes.
+
+enum class LockName : uint8_t
+{
+    RequestQueue,     // BakerStation::requestOrderLock
+    DeliveryProducer, // DeliveryChannel, bakers handing orders over (work stealing)
+    DeliveryConsumer, // DeliveryChannel, pickups racing for a queue (chaos)
+    DeliveryWait,     // DeliveryChannel, sleeping on an empty or full channel
+    Oven,             // Oven: bakers waiting for slots, the oven waiting for bread
+    OrderCompletion,  // a baker waiting for its breads to come out
+    ChaosPool,        // the chaos mode's customer task pool
+    Metrics,          // per-queue delivery samples
+    CoroExecutor,     // the coroutine backend's run queue and timers
+    CoroChannel,      // coroutine request and delivery channels
+    CoroOven,         // the coroutine oven
+    VirtualClock,     // virtual time bookkeeping
+    OrderFile,        // the order file's shared cursor
+    Count,
+};
+
+struct ProfiledMutex
+{
+    pthread_mutex_t mutex;
+    LockName name;
+    long long acquiredAt; // monotonic time the holder got it, while profiling
+};
+
+struct LockSummary
+{
+    const char *name;
+    long long acquires;
+    long long contended; // acquisitions that had to wait
+    long long condWaits; // waits on a ClockCond that released the mutex
+    long long waitNanos;
+    long long holdNanos;
+    long long waitP50; // over contended acquisitions; histogram bucket bounds
+    long long waitP99;
+    long long holdP99;
+};
+
+void profiledMutexInit(ProfiledMutex *mutex, LockName name);
+void profiledMutexDestroy(ProfiledMutex *mutex);
+
+// Clears the counters and turns profiling on; call before any actor starts.
+void lockProfileStart();
+// Turns profiling off once every actor is done; the counters stay for the report.
+void lockProfileStop();
+// Locks that were taken, most total wait first.
+std::vector<LockSummary> lockProfileSummary();
+void lockProfileReport(std::ostream &out);
+
+extern bool lockProfiling;
+void lockProfiledAcquire(ProfiledMutex *mutex);
+void lockProfiledRelease(ProfiledMutex *mutex);
+void lockProfiledSleep(ProfiledMutex *mutex);
+void lockProfiledWake(ProfiledMutex *mutex);
+
+inline void profiledLock(ProfiledMutex *mutex)
+{
+    if (lockProfiling)
+    {
+        lockProfiledAcquire(mutex);
+        return;
+    }
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+inline void profiledUnlock(ProfiledMutex *mutex)
+{
+    if (lockProfiling)
+    {
+        lockProfiledRelease(mutex);
+        return;
+    }
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+// ClockCond waits on a profiled mutex. The time asleep is not held time, so the hold ends
+// before the wait and starts over once the waiter has the mutex back.
+inline void clockCondWait(ClockCond *c, ProfiledMutex *mutex)
+{
+    if (lockProfiling)
+    {
+        lockProfiledSleep(mutex);
+    }
+    clockCondWait(c, &mutex->mutex);
+    if (lockProfiling)
+    {
+        lockProfiledWake(mutex);
+    }
+}
+
+inline bool clockCondTimedWait(ClockCond *c, ProfiledMutex *mutex, long long deadline)
+{
+    if (lockProfiling)
+    {
+        lockProfiledSleep(mutex);
+    }
+    bool signaled = clockCondTimedWait(c, &mutex->mutex, deadline);
+    if (lockProfiling)
+    {
+        lockProfiledWake(mutex);
+    }
+    return signaled;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include "bakery.h"
+#include "orderfile.h"
+
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " <single|multi|chaos> [options] < input\n"
+         << "  --bakers N          number of bakers (default: hardware concurrency)\n"
+         << "  --ovens N           number of ovens (default: 1)\n"
+         << "  --oven-capacity N   breads each oven holds at once, or a comma separated list with one\n"
+         << "                      value per oven (default: 10 x bakers, split over the ovens)\n"
+         << "  --bake-time S       seconds a bread spends in the oven, or one value per oven (default: 2)\n"
+         << "  --oven-policy KIND  how bakers pick an oven: static, least-loaded or two-choices\n"
+         << "                      (default: static)\n"
+         << "  --admission KIND    which waiting baker gets oven slots first: fifo, shortest-first,\n"
+         << "                      fair-share or earliest-deadline (default: fifo)\n"
+         << "  --max-breads N      max breads per customer order (default: 15)\n"
+         << "  --virtual-time      run on a simulated clock instead of the wall clock\n"
+         << "  --backend KIND      thread (one pthread per actor) or coro (coroutines, default: thread)\n"
+         << "  --work-stealing     idle bakers take orders waiting behind busy bakers (thread backend)\n"
+         << "  --log-level LEVEL   off, info (actors, elapsed seconds), debug (every order) or\n"
+         << "                      trace (every batch of breads) (default: debug)\n"
+         << "  --log-format KIND   text, jsonl, binary or chrome (a trace timeline; always at trace level)\n"
+         << "                      (default: text)\n"
+         << "  --log-file PATH     write the event log here instead of stdout\n"
+         << "  --stats-file PATH   keep live stats (Prometheus text format) in this file during the run\n"
+         << "  --stats-interval MS milliseconds between stats samples (default: 1000)\n"
+         << "  --lock-profile      report how long threads waited for and held each lock\n"
+         << "  --order-file PATH   replay orders from a text or binary order file instead of stdin\n"
+         << "  --validate-orders   check the whole order file before the run instead of as it is read\n"
+         << "  --results-file PATH write one binary row per delivered order here (read with bakery_results)\n"
+         << "  --schedule-seed N   run actors one at a time, picking who runs next with seed N\n"
+         << "                      (needs --virtual-time)\n"
+         << "  --schedule-record PATH  like --schedule-seed (seed 1 unless given), and write every pick to PATH\n"
+         << "  --schedule-replay PATH  repeat the picks of a recorded run\n"
+         << workloadUsage();
+    exit(EXIT_FAILURE);
+}
+
+// Digits only: no sign, blanks, fraction or trailing text. Too large a number saturates and
+// fails the limit.
+int parsePositive(const string &flag, const char *value, int limit = INT_MAX)
+{
+    char *end = nullptr;
+    long long number = value == nullptr ? 0 : strtoll(value, &end, 10);
+    if (value == nullptr || *value < '0' || *value > '9' || *end != '\0' || number <= 0)
+    {
+        cerr << flag << " expects a positive number. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    if (number > limit)
+    {
+        cerr << flag << " expects at most " << limit << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    return number;
+}
+
+// A single positive number, or a comma separated list of them.
+vector<int> parsePositiveList(const string &flag, const char *value)
+{
+    vector<int> numbers;
+    istringstream list(value == nullptr ? "" : value);
+    string item;
+    while (getline(list, item, ','))
+    {
+        numbers.push_back(parsePositive(flag, item.c_str()));
+    }
+    if (numbers.empty())
+    {
+        parsePositive(flag, nullptr);
+    }
+    return numbers;
+}
+
+// Stretches a one-value list to `count` values; other lengths must match.
+vector<int> perOven(const string &flag, vector<int> values, int count)
+{
+    if (values.size() == 1)
+    {
+        values.assign(count, values[0]);
+    }
+    if ((int)values.size() != count)
+    {
+        cerr << flag << " expects one value or one per oven. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+    }
+
+    string modeName = argv[1];
+    BakeryMode *mode = nullptr;
+    if (modeName == "single")
+    {
+        mode = createSingleBakerMode();
+    }
+    else if (modeName == "multi")
+    {
+        mode = createMultiBakerMode();
+    }
+    else if (modeName == "chaos")
+    {
+        mode = createChaosMode();
+    }
+    else
+    {
+        usage(argv[0]);
+    }
+
+    BakeryConfig config{};
+    config.bakerCount = max(1u, thread::hardware_concurrency());
+    config.ovenPolicy = OvenPolicy::Static;
+    config.admission = AdmissionPolicy::Fifo;
+    int ovenCount = 1;
+    vector<int> ovenCapacities;
+    vector<int> ovenBakingTimes = {2};
+    config.maxCustomerBreads = 15;
+    config.virtualTime = false;
+    config.backend = ExecutionBackend::Threads;
+    config.workStealing = false;
+    config.log = LogConfig{LogLevel::Debug, LogFormat::Text, ""};
+    config.stats = StatsConfig{"", 1000};
+    config.lockProfile = false;
+    config.schedule = ScheduleConfig{ScheduleMode::Free, "", 1};
+    WorkloadConfig workload = defaultWorkloadConfig();
+    string orderFile;
+    bool validateOrders = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        string flag = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (flag == "--bakers")
+        {
+            config.bakerCount = parsePositive(flag, value, MAX_BAKERS);
+            i++;
+        }
+        else if (flag == "--ovens")
+        {
+            ovenCount = parsePositive(flag, value);
+            i++;
+        }
+        else if (flag == "--oven-capacity")
+        {
+            ovenCapacities = parsePositiveList(flag, value);
+            i++;
+        }
+        else if (flag == "--bake-time")
+        {
+            ovenBakingTimes = parsePositiveList(flag, value);
+            i++;
+        }
+        else if (flag == "--oven-policy")
+        {
+            if (!parseOvenPolicy(value == nullptr ? "" : value, config.ovenPolicy))
+            {
+                cerr << "--oven-policy expects static, least-loaded or two-choices. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (flag == "--max-breads")
+        {
+            config.maxCustomerBreads = parsePositive(flag, value, MAX_ORDER_BREADS);
+            i++;
+        }
+        else if (flag == "--virtual-time")
+        {
+            config.virtualTime = true;
+        }
+        else if (flag == "--work-stealing")
+        {
+            config.workStealing = true;
+        }
+        else if (flag == "--log-level")
+        {
+            if (!parseLogLevel(value == nullptr ? "" : value, config.log.level))
+            {
+                cerr << "--log-level expects off, info, debug or trace. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (flag == "--log-format")
+        {
+            if (!parseLogFormat(value == nullptr ? "" : value, config.log.format))
+            {
+                cerr << "--log-format expects text, jsonl, binary or chrome. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (flag == "--log-file" && value != nullptr)
+        {
+            config.log.path = value;
+            i++;
+        }
+        else if (flag == "--stats-file" && value != nullptr)
+        {
+            config.stats.path = value;
+            i++;
+        }
+        else if (flag == "--stats-interval")
+        {
+            config.stats.intervalMs = parsePositive(flag, value);
+            i++;
+        }
+        else if (flag == "--order-file" && value != nullptr)
+        {
+            orderFile = value;
+            i++;
+        }
+        else if (flag == "--validate-orders")
+        {
+            validateOrders = true;
+        }
+        else if (flag == "--results-file" && value != nullptr)
+        {
+            config.resultsPath = value;
+            i++;
+        }
+        else if (flag == "--lock-profile")
+        {
+            config.lockProfile = true;
+        }
+        else if (flag == "--schedule-seed")
+        {
+            config.schedule.seed = parsePositive(flag, value);
+            if (config.schedule.mode == ScheduleMode::Free)
+            {
+                config.schedule.mode = ScheduleMode::Seeded;
+            }
+            i++;
+        }
+        else if ((flag == "--schedule-record" || flag == "--schedule-replay") && value != nullptr)
+        {
+            ScheduleMode mode = flag == "--schedule-record" ? ScheduleMode::Record : ScheduleMode::Replay;
+            bool hasFile = config.schedule.mode == ScheduleMode::Record || config.schedule.mode == ScheduleMode::Replay;
+            if (hasFile && config.schedule.mode != mode)
+            {
+                cerr << "--schedule-record and --schedule-replay cannot be combined. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            config.schedule.mode = mode;
+            config.schedule.path = value;
+            i++;
+        }
+        else if (flag == "--backend")
+        {
+            string backend = value == nullptr ? "" : value;
+            if (backend == "thread")
+            {
+                config.backend = ExecutionBackend::Threads;
+            }
+            else if (backend == "coro")
+            {
+                config.backend = ExecutionBackend::Coroutines;
+            }
+            else
+            {
+                cerr << "--backend expects thread or coro. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (flag == "--admission")
+        {
+            if (!parseAdmissionPolicy(value == nullptr ? "" : value, config.admission))
+            {
+                cerr << "--admission expects fifo, shortest-first, fair-share or earliest-deadline. exiting...\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (parseWorkloadFlag(flag, value, workload))
+        {
+            i++;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if (config.workStealing && config.backend != ExecutionBackend::Threads)
+    {
+        cerr << "--work-stealing needs the thread backend. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    if (config.schedule.mode != ScheduleMode::Free && !config.virtualTime)
+    {
+        cerr << "--schedule-seed, --schedule-record and --schedule-replay need --virtual-time. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    if (workload.enabled && !orderFile.empty())
+    {
+        cerr << "--workload and --order-file both supply the orders; pick one. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    config.bakerCount = mode->bakerCount(config);
+    if (ovenCapacities.empty())
+    {
+        ovenCapacities = {(config.bakerCount * 10 + ovenCount - 1) / ovenCount};
+    }
+    ovenCapacities = perOven("--oven-capacity", ovenCapacities, ovenCount);
+    ovenBakingTimes = perOven("--bake-time", ovenBakingTimes, ovenCount);
+    for (int i = 0; i < ovenCount; i++)
+    {
+        config.ovens.push_back(OvenConfig{ovenCapacities[i], ovenBakingTimes[i]});
+    }
+
+    Bakery bakery;
+    bakery.config = config;
+    OrderSource *orders;
+    if (workload.enabled)
+    {
+        orders = new WorkloadGenerator(workload, config.bakerCount, config.maxCustomerBreads);
+    }
+    else if (!orderFile.empty())
+    {
+        orders = new OrderFileSource(orderFile, config.bakerCount, config.maxCustomerBreads, validateOrders);
+    }
+    else
+    {
+        mode->readInput(cin, bakery);
+        orders = new RequestOrderSource(bakery.requests);
+    }
+    bakery.orders = orders;
+
+    cout << "\n\n**** Starting program (" << mode->name() << ", " << config.bakerCount << " bakers) **** \n\n";
+    long long elapsed = runSimulation(bakery, *mode);
+    string error = orders->error();
+    if (!error.empty())
+    {
+        cerr << error << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    cout << "\n\n**** Ending program **** \n\n";
+    cout << "Total Execution time: " << elapsed / NANOS_PER_SEC << " Seconds.\n";
+    bakery.metrics.report(cout, mode->name());
+    if (config.lockProfile)
+    {
+        lockProfileReport(cout);
+    }
+
+    delete orders;
+    delete mode;
+    return 0;
+}
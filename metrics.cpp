@@ -0,0 +1,354 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+// Buckets below 2^SUB_BITS hold one value each; above, bucket (shift + 1) * 2^SUB_BITS + k
+// holds the values whose top SUB_BITS + 1 bits are 2^SUB_BITS + k, `shift` bits further down.
+static size_t bucketOf(long long value, int subBits)
+{
+    long long subBuckets = 1LL << subBits;
+    if (value < subBuckets)
+    {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - subBits;
+    return (shift + 1) * subBuckets + ((value >> shift) - subBuckets);
+}
+
+void LatencyHistogram::record(long long nanoseconds)
+{
+    nanoseconds = max(nanoseconds, 0LL);
+    size_t bucket = bucketOf(nanoseconds, SUB_BITS);
+    if (counts.size() <= bucket)
+    {
+        counts.resize(bucket + 1, 0);
+        sums.resize(bucket + 1, 0);
+    }
+    counts[bucket]++;
+    sums[bucket] += nanoseconds;
+    samples++;
+    total += nanoseconds;
+    totalSquares += (double)nanoseconds * nanoseconds;
+    largest = max(largest, nanoseconds);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (counts.size() < other.counts.size())
+    {
+        counts.resize(other.counts.size(), 0);
+        sums.resize(other.counts.size(), 0);
+    }
+    for (size_t i = 0; i < other.counts.size(); i++)
+    {
+        counts[i] += other.counts[i];
+        sums[i] += other.sums[i];
+    }
+    samples += other.samples;
+    total += other.total;
+    totalSquares += other.totalSquares;
+    largest = max(largest, other.largest);
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary summary{};
+    summary.count = samples;
+    if (samples == 0)
+    {
+        return summary;
+    }
+    summary.mean = total / samples;
+    summary.stddev = sqrt(max(0.0, totalSquares / samples - summary.mean * summary.mean));
+    summary.max = largest;
+
+    double fractions[] = {0.50, 0.90, 0.99};
+    long long *targets[] = {&summary.p50, &summary.p90, &summary.p99};
+    size_t next = 0, seen = 0;
+    for (size_t i = 0; i < counts.size() && next < 3; i++)
+    {
+        seen += counts[i];
+        while (next < 3 && seen >= max<size_t>(1, (size_t)ceil(fractions[next] * samples)))
+        {
+            *targets[next++] = llround(sums[i] / counts[i]);
+        }
+    }
+    return summary;
+}
+
+string formatDuration(double nanoseconds)
+{
+    char buffer[32];
+    if (nanoseconds >= 1e9)
+    {
+        snprintf(buffer, sizeof(buffer), "%.3fs", nanoseconds / 1e9);
+    }
+    else if (nanoseconds >= 1e6)
+    {
+        snprintf(buffer, sizeof(buffer), "%.3fms", nanoseconds / 1e6);
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "%.3fus", nanoseconds / 1e3);
+    }
+    return buffer;
+}
+
+// Bucket k holds samples in [2^k, 2^(k+1)) microseconds; bucket 0 also takes everything below 1us.
+static int histogramBucket(long long nanoseconds)
+{
+    long long micros = nanoseconds / 1000;
+    int bucket = 0;
+    while (micros > 1)
+    {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void printLatencyHistogram(ostream &out, const LatencyHistogram &samples)
+{
+    if (samples.count() == 0)
+    {
+        return;
+    }
+
+    vector<long long> buckets;
+    samples.forEachBucket([&buckets](double mean, long long count) {
+        int bucket = histogramBucket(llround(mean));
+        if ((int)buckets.size() <= bucket)
+        {
+            buckets.resize(bucket + 1, 0);
+        }
+        buckets[bucket] += count;
+    });
+
+    int first = 0;
+    while (buckets[first] == 0)
+    {
+        first++;
+    }
+    long long largest = *max_element(buckets.begin(), buckets.end());
+    for (int bucket = first; bucket < (int)buckets.size(); bucket++)
+    {
+        char label[64];
+        snprintf(label, sizeof(label), "  [%10s, %10s) %8lld ", formatDuration(1000.0 * (1LL << bucket)).c_str(),
+                 formatDuration(1000.0 * (1LL << (bucket + 1))).c_str(), buckets[bucket]);
+        out << label << string((size_t)(40.0 * buckets[bucket] / largest), '#') << "\n";
+    }
+}
+
+MetricsCollector::~MetricsCollector()
+{
+    for (BakerSamples &baker : bakers)
+    {
+        profiledMutexDestroy(&baker.lock);
+    }
+}
+
+void MetricsCollector::reset(int bakerCount, bool workStealing, int ovenCount, bool racingCustomers)
+{
+    this->workStealing = workStealing;
+    this->racingCustomers = racingCustomers;
+    ovens.assign(ovenCount, 0);
+    for (BakerSamples &baker : bakers)
+    {
+        profiledMutexDestroy(&baker.lock);
+    }
+    bakers.clear();
+    bakers.resize(bakerCount);
+    for (BakerSamples &baker : bakers)
+    {
+        profiledMutexInit(&baker.lock, LockName::Metrics);
+        baker.breads = 0;
+        baker.steals = 0;
+        baker.overtakes = 0;
+    }
+    liveQueues = vector<LiveQueue>(bakerCount);
+}
+
+void MetricsCollector::recordPlaced(int queueIndex)
+{
+    liveQueues[queueIndex].queuedOrders.fetch_add(1, memory_order_relaxed);
+}
+
+void MetricsCollector::recordTaken(int bakerIndex, int queueIndex, long long at)
+{
+    liveQueues[queueIndex].queuedOrders.fetch_sub(1, memory_order_relaxed);
+    liveQueues[bakerIndex].busySince.store(at, memory_order_relaxed);
+}
+
+void MetricsCollector::recordHandedOver(int bakerIndex, int queueIndex, long long at)
+{
+    LiveQueue &baker = liveQueues[bakerIndex];
+    baker.busyNanos.fetch_add(at - baker.busySince.load(memory_order_relaxed), memory_order_relaxed);
+    baker.busySince.store(-1, memory_order_relaxed);
+    liveQueues[queueIndex].awaitingPickup.fetch_add(1, memory_order_relaxed);
+}
+
+void MetricsCollector::recordSteal(int bakerIndex)
+{
+    BakerSamples &baker = bakers[bakerIndex];
+    profiledLock(&baker.lock);
+    baker.steals++;
+    profiledUnlock(&baker.lock);
+}
+
+void MetricsCollector::recordOvertake(int queueIndex)
+{
+    BakerSamples &baker = bakers[queueIndex];
+    profiledLock(&baker.lock);
+    baker.overtakes++;
+    profiledUnlock(&baker.lock);
+}
+
+void MetricsCollector::recordOvenBreads(int ovenIndex, long long breads)
+{
+    ovens[ovenIndex] = breads;
+}
+
+long long MetricsCollector::steals(int bakerIndex) const
+{
+    profiledLock(&bakers[bakerIndex].lock);
+    long long steals = bakers[bakerIndex].steals;
+    profiledUnlock(&bakers[bakerIndex].lock);
+    return steals;
+}
+
+long long MetricsCollector::overtakes(int queueIndex) const
+{
+    profiledLock(&bakers[queueIndex].lock);
+    long long overtakes = bakers[queueIndex].overtakes;
+    profiledUnlock(&bakers[queueIndex].lock);
+    return overtakes;
+}
+
+void MetricsCollector::recordDelivery(int bakerIndex, const OrderTimestamps &timestamps, int breadCount)
+{
+    BakerSamples &baker = bakers[bakerIndex];
+    profiledLock(&baker.lock);
+    baker.orderToDelivery.record(timestamps.deliveredAt - timestamps.enqueuedAt);
+    baker.waiting.record(timestamps.firstBreadInAt - timestamps.enqueuedAt);
+    baker.baking.record(timestamps.lastBreadOutAt - timestamps.firstBreadInAt);
+    baker.handOver.record(timestamps.deliveredAt - timestamps.lastBreadOutAt);
+    baker.breads += breadCount;
+    profiledUnlock(&baker.lock);
+
+    LiveQueue &queue = liveQueues[bakerIndex];
+    queue.awaitingPickup.fetch_sub(1, memory_order_relaxed);
+    queue.deliveredOrders.fetch_add(1, memory_order_relaxed);
+    queue.deliveredBreads.fetch_add(breadCount, memory_order_relaxed);
+}
+
+LatencyHistogram MetricsCollector::orderToDelivery(int bakerIndex) const
+{
+    LatencyHistogram samples;
+    for (int i = 0; i < (int)bakers.size(); i++)
+    {
+        if (bakerIndex >= 0 && i != bakerIndex)
+        {
+            continue;
+        }
+        profiledLock(&bakers[i].lock);
+        samples.merge(bakers[i].orderToDelivery);
+        profiledUnlock(&bakers[i].lock);
+    }
+    return samples;
+}
+
+long long MetricsCollector::deliveredBreads() const
+{
+    long long breads = 0;
+    for (const BakerSamples &baker : bakers)
+    {
+        profiledLock(&baker.lock);
+        breads += baker.breads;
+        profiledUnlock(&baker.lock);
+    }
+    return breads;
+}
+
+static void printSummaryRow(ostream &out, const string &label, const LatencyHistogram &samples)
+{
+    LatencySummary summary = samples.summary();
+    char row[256];
+    snprintf(row, sizeof(row), "%-10s %8zu %12s %12s %12s %12s %12s %12s\n", label.c_str(), summary.count,
+             formatDuration(summary.mean).c_str(), formatDuration(summary.stddev).c_str(),
+             formatDuration(summary.p50).c_str(), formatDuration(summary.p90).c_str(),
+             formatDuration(summary.p99).c_str(), formatDuration(summary.max).c_str());
+    out << row;
+}
+
+void MetricsCollector::report(ostream &out, const char *modeName) const
+{
+    out << "\n==== Order-to-delivery latency (" << modeName << " mode) ====\n";
+    char header[256];
+    snprintf(header, sizeof(header), "%-10s %8s %12s %12s %12s %12s %12s %12s\n", "queue", "orders", "mean",
+             "stddev", "p50", "p90", "p99", "max");
+    out << header;
+    for (int i = 0; i < (int)bakers.size(); i++)
+    {
+        printSummaryRow(out, "baker #" + to_string(i), orderToDelivery(i));
+    }
+    LatencyHistogram all = orderToDelivery(-1);
+    printSummaryRow(out, "all", all);
+
+    // Where the time went: waiting for a baker and an oven slot, baking, and the hand-over.
+    LatencyHistogram waiting, baking, handOver;
+    for (const BakerSamples &baker : bakers)
+    {
+        profiledLock(&baker.lock);
+        waiting.merge(baker.waiting);
+        baking.merge(baker.baking);
+        handOver.merge(baker.handOver);
+        profiledUnlock(&baker.lock);
+    }
+    out << "\nphases:\n";
+    printSummaryRow(out, "waiting", waiting);
+    printSummaryRow(out, "baking", baking);
+    printSummaryRow(out, "hand-over", handOver);
+
+    if (workStealing)
+    {
+        // Rows above are by customer queue; these count the orders each baker took from other queues.
+        out << "\nwork stealing (orders taken from other queues):\n";
+        for (int i = 0; i < (int)bakers.size(); i++)
+        {
+            char row[64];
+            snprintf(row, sizeof(row), "%-10s %8lld\n", ("baker #" + to_string(i)).c_str(), steals(i));
+            out << row;
+        }
+    }
+
+    if (racingCustomers)
+    {
+        // Nonzero rows show that the race, not the arrival order, decided who was served first.
+        out << "\ncustomers served ahead of an earlier arrival:\n";
+        for (int i = 0; i < (int)bakers.size(); i++)
+        {
+            char row[64];
+            snprintf(row, sizeof(row), "%-10s %8lld\n", ("baker #" + to_string(i)).c_str(), overtakes(i));
+            out << row;
+        }
+    }
+
+    if (ovens.size() > 1)
+    {
+        out << "\novens (breads baked):\n";
+        for (int i = 0; i < (int)ovens.size(); i++)
+        {
+            char row[64];
+            snprintf(row, sizeof(row), "%-10s %8lld\n", ("oven #" + to_string(i)).c_str(), ovens[i]);
+            out << row;
+        }
+    }
+
+    out << "\nhistogram (all orders):\n";
+    printLatencyHistogram(out, all);
+}
@@ -0,0 +1,140 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "lockprof.h"
+#include "pthread.h"
+
+// clockNow() nanoseconds at each step of an order's life; 0 means "not yet".
+struct OrderTimestamps
+{
+    long long enqueuedAt;
+    long long firstBreadInAt;
+    long long lastBreadOutAt;
+    long long deliveredAt;
+};
+
+struct LatencySummary
+{
+    size_t count;
+    double mean;
+    double stddev;
+    long long p50;
+    long long p90;
+    long long p99;
+    long long max;
+};
+
+// Nanosecond samples in log-linear buckets, like an HDR histogram: below 2^SUB_BITS ns every
+// value has a bucket of its own, above it each power of two is split into 2^SUB_BITS buckets.
+// A bucket keeps the sum of its samples, so it stands for their mean, which is exact when
+// they are all equal. Memory grows with the largest sample, never with the number of them.
+class LatencyHistogram
+{
+public:
+    void record(long long nanoseconds);
+    void merge(const LatencyHistogram &other);
+    size_t count() const { return samples; }
+    // Mean and stddev are exact, percentiles (nearest rank) the mean of the bucket they fall in.
+    LatencySummary summary() const;
+    // Calls visit(mean, count) for every bucket with samples, smallest first.
+    template <typename Visit>
+    void forEachBucket(Visit visit) const
+    {
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            if (counts[i] > 0)
+            {
+                visit(sums[i] / counts[i], counts[i]);
+            }
+        }
+    }
+
+private:
+    static const int SUB_BITS = 6;
+
+    std::vector<long long> counts;
+    std::vector<double> sums;
+    size_t samples = 0;
+    double total = 0;
+    double totalSquares = 0;
+    long long largest = 0;
+};
+
+// Formats nanoseconds as seconds, milliseconds or microseconds.
+std::string formatDuration(double nanoseconds);
+
+// Prints a log2-bucketed histogram of the samples.
+void printLatencyHistogram(std::ostream &out, const LatencyHistogram &samples);
+
+// Collects delivered orders per baker queue and prints the end-of-run report.
+class MetricsCollector
+{
+public:
+    // Live gauges of one queue and of the baker with the same index, updated with relaxed
+    // atomics as orders move along and sampled by the stats writer (stats.h) during the run.
+    struct alignas(64) LiveQueue
+    {
+        std::atomic<long long> queuedOrders{0};   // placed, not yet taken by a baker
+        std::atomic<long long> awaitingPickup{0}; // handed over, not yet collected
+        std::atomic<long long> deliveredOrders{0};
+        std::atomic<long long> deliveredBreads{0};
+        std::atomic<long long> busyNanos{0};  // the baker's time on the orders it finished
+        std::atomic<long long> busySince{-1}; // clockNow() it took its current order, -1 when idle
+    };
+
+    MetricsCollector() = default;
+    MetricsCollector(const MetricsCollector &) = delete;
+    MetricsCollector &operator=(const MetricsCollector &) = delete;
+    ~MetricsCollector();
+
+    // workStealing adds per-baker steal counts to the report, several ovens their bread counts,
+    // racingCustomers the overtakes of each queue.
+    void reset(int bakerCount, bool workStealing = false, int ovenCount = 1, bool racingCustomers = false);
+    void recordDelivery(int bakerIndex, const OrderTimestamps &timestamps, int breadCount);
+    // Baker `bakerIndex` took an order from another baker's queue.
+    void recordSteal(int bakerIndex);
+    // A customer of queue `queueIndex` reached the counter ahead of one who arrived before it.
+    void recordOvertake(int queueIndex);
+    // Called once per oven at the end of a run.
+    void recordOvenBreads(int ovenIndex, long long breads);
+    // An order was placed in queue `queueIndex`, taken from it by baker `bakerIndex` at
+    // clockNow() time `at`, and handed over by that baker at `at`. recordDelivery() closes it.
+    void recordPlaced(int queueIndex);
+    void recordTaken(int bakerIndex, int queueIndex, long long at);
+    void recordHandedOver(int bakerIndex, int queueIndex, long long at);
+    const LiveQueue &live(int index) const { return liveQueues[index]; }
+
+    // Order-to-delivery (enqueued -> delivered) samples of one queue, or of all queues if bakerIndex < 0.
+    LatencyHistogram orderToDelivery(int bakerIndex) const;
+    long long deliveredBreads() const;
+    long long steals(int bakerIndex) const;
+    long long overtakes(int queueIndex) const;
+
+    void report(std::ostream &out, const char *modeName) const;
+
+private:
+    struct BakerSamples
+    {
+        mutable ProfiledMutex lock;
+        LatencyHistogram orderToDelivery;
+        // The phases of an order: waiting for a baker and an oven slot, baking, the hand-over.
+        LatencyHistogram waiting;
+        LatencyHistogram baking;
+        LatencyHistogram handOver;
+        long long breads;
+        long long steals;
+        long long overtakes;
+    };
+
+    std::vector<BakerSamples> bakers;
+    std::vector<LiveQueue> liveQueues;
+    std::vector<long long> ovens; // breads baked by each oven
+    bool workStealing;
+    bool racingCustomers;
+};
+
+#endif
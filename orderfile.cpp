@@ -0,0 +1,420 @@
+#include "orderfile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sim_clock.h"
+
+using namespace std;
+
+static const char ORDER_FILE_MAGIC[8] = {'B', 'A', 'K', 'E', 'O', 'R', 'D', '1'};
+
+// Pages are released each time the cursor moves this far.
+static const size_t RELEASE_STEP = 64 << 20;
+
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skipBlanks(const char *&at, const char *end)
+{
+    while (at < end && isBlank(*at))
+    {
+        at++;
+    }
+}
+
+// Unsigned decimal; false if there is no digit or it does not fit in `limit`.
+static bool parseUnsigned(const char *&at, const char *end, unsigned long long limit, unsigned long long &value)
+{
+    const char *first = at;
+    value = 0;
+    while (at < end && *at >= '0' && *at <= '9')
+    {
+        value = value * 10 + (*at - '0');
+        if (value > limit)
+        {
+            return false;
+        }
+        at++;
+    }
+    return at > first;
+}
+
+// Non-negative seconds with an optional fraction, to nanoseconds; digits past the
+// ninth decimal are dropped.
+static bool parseSeconds(const char *&at, const char *end, long long &nanoseconds)
+{
+    unsigned long long seconds;
+    if (!parseUnsigned(at, end, 1000000000ULL, seconds))
+    {
+        return false;
+    }
+    nanoseconds = (long long)seconds * NANOS_PER_SEC;
+    if (at < end && *at == '.')
+    {
+        at++;
+        long long scale = NANOS_PER_SEC / 10;
+        while (at < end && *at >= '0' && *at <= '9')
+        {
+            nanoseconds += (*at - '0') * scale;
+            scale /= 10;
+            at++;
+        }
+    }
+    return true;
+}
+
+// Parses one order line into `record`; arrivalAt is -1 when the line has none. Returns what
+// is wrong with the line, or nullptr.
+static const char *parseOrder(const char *field, const char *lineEnd, OrderFileRecord &record)
+{
+    unsigned long long customerId, breads, queue;
+    if (!parseUnsigned(field, lineEnd, UINT32_MAX, customerId))
+    {
+        return "expected a customer id";
+    }
+    skipBlanks(field, lineEnd);
+    if (!parseUnsigned(field, lineEnd, UINT16_MAX, breads))
+    {
+        return "expected a bread count";
+    }
+    skipBlanks(field, lineEnd);
+    if (!parseUnsigned(field, lineEnd, UINT16_MAX, queue))
+    {
+        return "expected a queue";
+    }
+    skipBlanks(field, lineEnd);
+    long long arrivalAt = -1;
+    if (field < lineEnd && !parseSeconds(field, lineEnd, arrivalAt))
+    {
+        return "expected an arrival time in seconds";
+    }
+    skipBlanks(field, lineEnd);
+    if (field < lineEnd)
+    {
+        return "unexpected text after the order";
+    }
+
+    record.customerId = customerId;
+    record.breadCount = breads;
+    record.bakerIndex = queue;
+    record.arrivalAt = arrivalAt;
+    return nullptr;
+}
+
+OrderFileSource::OrderFileSource(const string &path, int bakerCount, int maxCustomerBreads, bool validateFirst)
+    : path(path), maxCustomerBreads(maxCustomerBreads), data(nullptr), size(0), start(0), binary(false),
+      openLoop(false), cursor(0), cursorNumber(0), queues(bakerCount), released(0)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0)
+    {
+        cerr << "cannot open order file " << path << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    size = status.st_size;
+    if (size > 0)
+    {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED)
+        {
+            cerr << "cannot map order file " << path << ". exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+        data = (const char *)mapping;
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+    close(file);
+
+    if (size >= sizeof(OrderFileHeader) && memcmp(data, ORDER_FILE_MAGIC, sizeof(ORDER_FILE_MAGIC)) == 0)
+    {
+        OrderFileHeader header;
+        memcpy(&header, data, sizeof(header));
+        binary = true;
+        start = sizeof(header);
+        openLoop = header.flags & ORDER_FILE_OPEN_LOOP;
+        if (header.recordSize != sizeof(OrderFileRecord) || (size - start) % sizeof(OrderFileRecord) != 0)
+        {
+            cerr << "order file " << path << " has a bad record size or a truncated record. exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    else
+    {
+        // The first order decides whether a text file is open or closed loop.
+        size_t offset = start;
+        long long line = 0;
+        OrderFileRecord record;
+        const char *problem;
+        if (parseLine(offset, record, line, problem))
+        {
+            if (problem != nullptr)
+            {
+                malformed(line, problem);
+            }
+            openLoop = record.arrivalAt >= 0;
+        }
+    }
+    if (validateFirst)
+    {
+        validate();
+    }
+
+    profiledMutexInit(&lock, LockName::OrderFile);
+    cursor = start;
+    for (QueueBuffer &queue : queues)
+    {
+        queue.behind = false;
+        queue.catchUp = start;
+    }
+}
+
+OrderFileSource::~OrderFileSource()
+{
+    profiledMutexDestroy(&lock);
+    if (data != nullptr)
+    {
+        munmap((void *)data, size);
+    }
+}
+
+string OrderFileSource::describe(long long number, const char *problem) const
+{
+    return "order file " + path + (binary ? " record " : " line ") + to_string(number) + ": " + problem;
+}
+
+void OrderFileSource::malformed(long long number, const char *problem) const
+{
+    cerr << describe(number, problem) << ". exiting...\n";
+    exit(EXIT_FAILURE);
+}
+
+// Moves `offset` past the order line at (or first after) it and parses that line into
+// `record`, setting `problem` if it is malformed. `line` counts the lines passed. False at
+// the end of the file.
+bool OrderFileSource::parseLine(size_t &offset, OrderFileRecord &record, long long &line, const char *&problem) const
+{
+    const char *end = data + size;
+    const char *at = data + offset;
+    while (at < end)
+    {
+        const char *lineEnd = (const char *)memchr(at, '\n', end - at);
+        if (lineEnd == nullptr)
+        {
+            lineEnd = end;
+        }
+        line++;
+        const char *field = at;
+        at = lineEnd < end ? lineEnd + 1 : end;
+        skipBlanks(field, lineEnd);
+        if (field == lineEnd || *field == '#')
+        {
+            continue;
+        }
+        problem = parseOrder(field, lineEnd, record);
+        offset = at - data;
+        return true;
+    }
+    offset = size;
+    return false;
+}
+
+// Reads the record at `offset` and moves `offset` past it; `number` counts the lines (or
+// records) passed. `problem` is set if the record is malformed or does not fit the run.
+// False at the end of the file.
+bool OrderFileSource::readRecord(size_t &offset, OrderFileRecord &record, long long &number, const char *&problem) const
+{
+    problem = nullptr;
+    if (binary)
+    {
+        if (offset >= size)
+        {
+            return false;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        number++;
+        if (openLoop && record.arrivalAt < 0)
+        {
+            problem = "negative arrival time";
+        }
+    }
+    else
+    {
+        if (!parseLine(offset, record, number, problem))
+        {
+            return false;
+        }
+        if (problem == nullptr && (record.arrivalAt >= 0) != openLoop)
+        {
+            problem = openLoop ? "missing arrival time" : "arrival time in a file whose first order has none";
+        }
+    }
+    if (problem != nullptr)
+    {
+        return true;
+    }
+    if (record.bakerIndex >= queues.size())
+    {
+        problem = "queue out of range for the number of bakers";
+    }
+    else if (record.breadCount < 1 || record.breadCount > maxCustomerBreads)
+    {
+        problem = "bread count out of range (see --max-breads)";
+    }
+    return true;
+}
+
+// --validate-orders: reads the whole file once before the run.
+void OrderFileSource::validate()
+{
+    size_t offset = start;
+    long long number = 0;
+    OrderFileRecord record;
+    const char *problem;
+    while (readRecord(offset, record, number, problem))
+    {
+        if (problem != nullptr)
+        {
+            malformed(number, problem);
+        }
+        if (offset / RELEASE_STEP != released / RELEASE_STEP)
+        {
+            releasePages(offset);
+        }
+    }
+    releasePages(size);
+    released = 0;
+}
+
+// Drops the pages below `upTo`. Those are clean file pages: this only keeps the resident
+// size flat, and a queue that reads them again faults them back in.
+void OrderFileSource::releasePages(size_t upTo)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    upTo -= upTo % page;
+    if (upTo > released)
+    {
+        madvise((void *)(data + released), upTo - released, MADV_DONTNEED);
+        released = upTo;
+    }
+}
+
+// Looks for the queue's next order between its catchUp offset and `end`. Runs without the
+// lock: the stretch is behind the cursor, so it was already checked, and only the queue's
+// own agent moves catchUp while the queue is behind.
+bool OrderFileSource::catchUp(int bakerIndex, size_t end, OrderFileRecord &record)
+{
+    QueueBuffer &queue = queues[bakerIndex];
+    long long number = 0;
+    const char *problem;
+    while (queue.catchUp < end && readRecord(queue.catchUp, record, number, problem))
+    {
+        if (record.bakerIndex == bakerIndex)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves the cursor on to the queue's next order, handing the other queues' orders to their
+// buffers; called with the lock held. A malformed record fails the source.
+bool OrderFileSource::advance(int bakerIndex, OrderFileRecord &record)
+{
+    size_t before = cursor;
+    bool found = false;
+    while (!found)
+    {
+        size_t at = cursor;
+        const char *problem;
+        if (!readRecord(cursor, record, cursorNumber, problem))
+        {
+            break;
+        }
+        if (problem != nullptr)
+        {
+            failure = describe(cursorNumber, problem);
+            break;
+        }
+        found = record.bakerIndex == bakerIndex;
+        QueueBuffer &other = queues[record.bakerIndex];
+        if (found || other.behind)
+        {
+            continue;
+        }
+        if (other.records.size() < BUFFER_RECORDS)
+        {
+            other.records.push_back(record);
+        }
+        else
+        {
+            other.behind = true;
+            other.catchUp = at;
+        }
+    }
+    if (cursor / RELEASE_STEP != before / RELEASE_STEP || cursor == size)
+    {
+        releasePages(cursor);
+    }
+    return found;
+}
+
+bool OrderFileSource::next(int bakerIndex, OrderSpec &order)
+{
+    QueueBuffer &queue = queues[bakerIndex];
+    OrderFileRecord record;
+    bool found = false;
+    profiledLock(&lock);
+    while (!found && failure.empty())
+    {
+        if (!queue.records.empty())
+        {
+            record = queue.records.front();
+            queue.records.pop_front();
+            found = true;
+        }
+        else if (queue.behind && queue.catchUp < cursor)
+        {
+            // The queue's orders between catchUp and the cursor were dropped: look for them
+            // while the cursor goes on, then check again for orders it skipped meanwhile.
+            size_t end = cursor;
+            profiledUnlock(&lock);
+            found = catchUp(bakerIndex, end, record);
+            profiledLock(&lock);
+        }
+        else
+        {
+            queue.behind = false;
+            found = advance(bakerIndex, record);
+            break;
+        }
+    }
+    found = found && failure.empty();
+    profiledUnlock(&lock);
+    if (!found)
+    {
+        return false;
+    }
+
+    order.customerId = record.customerId;
+    order.breadCount = record.breadCount;
+    order.arrivalAt = openLoop ? record.arrivalAt : 0;
+    order.thinkTime = 0;
+    return true;
+}
+
+string OrderFileSource::error() const
+{
+    profiledLock(&lock);
+    string copy = failure;
+    profiledUnlock(&lock);
+    return copy;
+}
@@ -0,0 +1,93 @@
+#ifndef ORDERFILE_H
+#define ORDERFILE_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "lockprof.h"
+#include "workload.h"
+
+// Order files: recorded orders replayed from a memory-mapped file, parsed as the
+// customers need them, so a run keeps the same footprint however large the file is. Two
+// layouts, told apart by the magic at the start:
+//
+// text, one order per line (blank lines and lines starting with '#' are skipped):
+//     <customer id> <breads> <queue> [<arrival seconds>]
+// With arrival times on every line the file is open loop (each order is placed at its
+// time); without any it is closed loop, like stdin input.
+//
+// binary: an OrderFileHeader followed by OrderFileRecords, host byte order.
+
+struct OrderFileHeader
+{
+    char magic[8];       // "BAKEORD1"
+    uint32_t recordSize; // sizeof(OrderFileRecord)
+    uint32_t flags;      // ORDER_FILE_OPEN_LOOP
+};
+
+const uint32_t ORDER_FILE_OPEN_LOOP = 1; // records carry arrival times
+
+struct OrderFileRecord
+{
+    uint32_t customerId;
+    uint16_t breadCount;
+    uint16_t bakerIndex;
+    int64_t arrivalAt; // nanoseconds; ignored in closed loop
+};
+
+static_assert(sizeof(OrderFileRecord) == 16, "OrderFileRecord is a file format");
+
+// One cursor parses the mapping for every queue under a lock: a queue that needs an order
+// takes it from its buffer, or moves the cursor on, handing the other queues' orders to their
+// buffers. A queue that falls BUFFER_RECORDS orders behind stops being buffered and later
+// scans the stretch it missed by itself, outside the lock, so memory stays bounded however
+// skewed the queues are. Pages behind the cursor are handed back to the kernel; a queue
+// catching up reads them in again. Records are checked as the cursor reaches them, so the
+// run starts at once: a malformed one stops every queue and is reported by error(). With
+// validateFirst the whole file is checked before the run instead.
+class OrderFileSource : public OrderSource
+{
+public:
+    OrderFileSource(const std::string &path, int bakerCount, int maxCustomerBreads, bool validateFirst);
+    ~OrderFileSource() override;
+    bool next(int bakerIndex, OrderSpec &order) override;
+    bool closedLoop() const override { return !openLoop; }
+    std::string customerName(uint32_t customerId) const override { return "c" + std::to_string(customerId); }
+    std::string error() const override;
+
+private:
+    static const size_t BUFFER_RECORDS = 1024;
+
+    struct QueueBuffer
+    {
+        std::deque<OrderFileRecord> records; // found by the cursor, at most BUFFER_RECORDS
+        bool behind;                         // orders from `catchUp` to the cursor were not kept
+        size_t catchUp;                      // where the queue's own scan resumes
+    };
+
+    bool parseLine(size_t &offset, OrderFileRecord &record, long long &line, const char *&problem) const;
+    bool readRecord(size_t &offset, OrderFileRecord &record, long long &number, const char *&problem) const;
+    void validate();
+    void releasePages(size_t upTo);
+    bool catchUp(int bakerIndex, size_t end, OrderFileRecord &record);
+    bool advance(int bakerIndex, OrderFileRecord &record);
+    std::string describe(long long number, const char *problem) const;
+    [[noreturn]] void malformed(long long number, const char *problem) const;
+
+    std::string path;
+    int maxCustomerBreads;
+    const char *data;
+    size_t size;
+    size_t start; // first record
+    bool binary;
+    bool openLoop;
+    mutable ProfiledMutex lock; // guards everything below, except a behind queue's catchUp
+    size_t cursor;
+    long long cursorNumber; // line (or record) number of the cursor
+    std::vector<QueueBuffer> queues;
+    size_t released; // bytes before this were dropped from memory
+    std::string failure; // the first malformed record the cursor met
+};
+
+#endif
@@ -0,0 +1,360 @@
+#include "oven.h"
+
+#include <algorithm>
+#include "eventlog.h"
+#include <vector>
+
+using namespace std;
+
+void orderCompletionInit(OrderCompletion *completion)
+{
+    completion->remainingBreads = 0;
+    completion->lastBreadOutAt = 0;
+    profiledMutexInit(&completion->lock, LockName::OrderCompletion);
+    clockCondInit(&completion->done);
+}
+
+void orderCompletionDestroy(OrderCompletion *completion)
+{
+    profiledMutexDestroy(&completion->lock);
+    clockCondDestroy(&completion->done);
+}
+
+void orderCompletionStart(OrderCompletion *completion, int breadCount)
+{
+    profiledLock(&completion->lock);
+    completion->remainingBreads = breadCount;
+    completion->lastBreadOutAt = 0;
+    profiledUnlock(&completion->lock);
+}
+
+static void orderCompletionBreadDone(OrderCompletion *completion)
+{
+    profiledLock(&completion->lock);
+    if (--completion->remainingBreads == 0)
+    {
+        completion->lastBreadOutAt = clockNow();
+        clockCondSignal(&completion->done);
+    }
+    profiledUnlock(&completion->lock);
+}
+
+void orderCompletionWait(OrderCompletion *completion)
+{
+    profiledLock(&completion->lock);
+    while (completion->remainingBreads > 0)
+    {
+        clockCondWait(&completion->done, &completion->lock);
+    }
+    profiledUnlock(&completion->lock);
+}
+
+bool parseOvenPolicy(const string &name, OvenPolicy &policy)
+{
+    if (name == "static")
+    {
+        policy = OvenPolicy::Static;
+    }
+    else if (name == "least-loaded")
+    {
+        policy = OvenPolicy::LeastLoaded;
+    }
+    else if (name == "two-choices")
+    {
+        policy = OvenPolicy::TwoChoices;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool parseAdmissionPolicy(const string &name, AdmissionPolicy &policy)
+{
+    if (name == "fifo")
+    {
+        policy = AdmissionPolicy::Fifo;
+    }
+    else if (name == "shortest-first")
+    {
+        policy = AdmissionPolicy::ShortestFirst;
+    }
+    else if (name == "fair-share")
+    {
+        policy = AdmissionPolicy::FairShare;
+    }
+    else if (name == "earliest-deadline")
+    {
+        policy = AdmissionPolicy::EarliestDeadline;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void AdmissionScheduler::init(AdmissionPolicy policy, int bakerCount, long long bakingTime)
+{
+    this->policy = policy;
+    this->bakingTime = bakingTime;
+    tickets = 0;
+    virtualTime = 0;
+    finishTags.assign(bakerCount, 0);
+    waiting.clear();
+}
+
+void AdmissionScheduler::add(int bakerIndex, int count, int firstIndex, long long orderPlacedAt)
+{
+    Request request{0, tickets++, bakerIndex, count};
+    switch (policy)
+    {
+    case AdmissionPolicy::Fifo:
+        break;
+    case AdmissionPolicy::ShortestFirst:
+        request.key = count;
+        break;
+    case AdmissionPolicy::FairShare:
+        request.key = max(virtualTime, finishTags[bakerIndex]);
+        break;
+    case AdmissionPolicy::EarliestDeadline:
+        request.key = orderPlacedAt + (firstIndex + count) * bakingTime;
+        break;
+    }
+
+    auto servedLater = [](const Request &a, const Request &b)
+    {
+        return a.key != b.key ? a.key > b.key : a.ticket > b.ticket;
+    };
+    waiting.insert(upper_bound(waiting.begin(), waiting.end(), request, servedLater), request);
+}
+
+void AdmissionScheduler::pop(int granted)
+{
+    const Request &served = waiting.back();
+    if (policy == AdmissionPolicy::FairShare)
+    {
+        virtualTime = served.key;
+        finishTags[served.bakerIndex] = served.key + granted;
+    }
+    waiting.pop_back();
+}
+
+void Oven::init(int capacity, int bakingTime, AdmissionPolicy admission, const vector<OrderCompletion *> &completions)
+{
+    this->completions = completions;
+    slots = capacity;
+    this->bakingTime = bakingTime * NANOS_PER_SEC;
+    unsigned long long ringSize = 1;
+    while (ringSize < (unsigned long long)capacity)
+    {
+        ringSize <<= 1;
+    }
+    ringMask = ringSize - 1;
+    cells = new Cell[ringSize];
+    for (unsigned long long i = 0; i < ringSize; i++)
+    {
+        cells[i].sequence.store(0, memory_order_relaxed); // no position publishes 0
+    }
+    head = 0;
+    baked.store(0);
+    tail.store(0);
+    freeSlots.store(capacity);
+    slotWaiters.store(0);
+    ovenSleeping.store(false);
+    bakersWorking.store(completions.size());
+
+    this->admission.init(admission, completions.size(), this->bakingTime);
+    grants.assign(completions.size(), 0);
+    profiledMutexInit(&lock, LockName::Oven);
+    slotsGranted = vector<ClockCond>(completions.size());
+    for (ClockCond &granted : slotsGranted)
+    {
+        clockCondInit(&granted);
+    }
+    clockCondInit(&breadArrived);
+}
+
+void Oven::destroy()
+{
+    delete[] cells;
+    cells = nullptr;
+    profiledMutexDestroy(&lock);
+    for (ClockCond &granted : slotsGranted)
+    {
+        clockCondDestroy(&granted);
+    }
+    clockCondDestroy(&breadArrived);
+}
+
+// Takes between 1 and `count` free slots; returns how many.
+int Oven::reserveSlots(int bakerIndex, int count, int firstIndex, long long orderPlacedAt)
+{
+    // Nobody queued: help ourselves.
+    int free = freeSlots.load(memory_order_relaxed);
+    while (slotWaiters.load(memory_order_relaxed) == 0 && free > 0)
+    {
+        int granted = min(free, count);
+        if (freeSlots.compare_exchange_weak(free, free - granted, memory_order_acquire, memory_order_relaxed))
+        {
+            return granted;
+        }
+    }
+
+    // Oven full or bakers waiting: queue up and sleep until the scheduler grants us slots.
+    // Announcing ourselves before grantWaiting() re-checks the free slots pairs with the
+    // fence in releaseSlots(), so the wake-up cannot be missed.
+    profiledLock(&lock);
+    slotWaiters.fetch_add(1, memory_order_seq_cst);
+    admission.add(bakerIndex, count, firstIndex, orderPlacedAt);
+    grants[bakerIndex] = 0;
+    grantWaiting();
+    while (grants[bakerIndex] == 0)
+    {
+        clockCondWait(&slotsGranted[bakerIndex], &lock);
+    }
+    slotWaiters.fetch_sub(1, memory_order_relaxed);
+    int granted = grants[bakerIndex];
+    profiledUnlock(&lock);
+    return granted;
+}
+
+// Hands free slots to queued bakers in admission order; lock must be held.
+void Oven::grantWaiting()
+{
+    while (!admission.empty())
+    {
+        const AdmissionScheduler::Request &next = admission.front();
+        int free = freeSlots.load(memory_order_seq_cst);
+        if (free == 0)
+        {
+            break;
+        }
+        int count = min(free, next.count);
+        if (!freeSlots.compare_exchange_weak(free, free - count, memory_order_acquire, memory_order_relaxed))
+        {
+            continue;
+        }
+        grants[next.bakerIndex] = count;
+        clockCondSignal(&slotsGranted[next.bakerIndex]);
+        admission.pop(count);
+    }
+}
+
+void Oven::releaseSlots(int count)
+{
+    freeSlots.fetch_add(count, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (slotWaiters.load(memory_order_relaxed) > 0)
+    {
+        profiledLock(&lock);
+        grantWaiting();
+        profiledUnlock(&lock);
+    }
+}
+
+// Slots for `count` breads must already be reserved. The clock is read before the ring
+// positions are claimed, so the stamps only run backwards in ring order when a baker is held
+// up between the two, which never happens in virtual time: the clock stands still while an
+// actor runs. Such a bread then waits behind the later-stamped one before it and comes out
+// late by at most that hold-up.
+long long Oven::publish(int bakerIndex, uint32_t customerId, int firstIndex, int count)
+{
+    long long insertedAt = clockNow();
+    unsigned long long position = tail.fetch_add(count, memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        Cell &cell = cells[(position + i) & ringMask];
+        cell.bread.readyAt = insertedAt + bakingTime;
+        cell.bread.customerId = customerId;
+        cell.bread.index = firstIndex + i;
+        cell.bread.bakerIndex = bakerIndex;
+        cell.sequence.store(position + i + 1, memory_order_release);
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ovenSleeping.load(memory_order_relaxed))
+    {
+        profiledLock(&lock);
+        clockCondSignal(&breadArrived);
+        profiledUnlock(&lock);
+    }
+    return insertedAt;
+}
+
+long long Oven::insertAvailable(int bakerIndex, uint32_t customerId, long long orderPlacedAt, int firstIndex, int count,
+                                int &inserted)
+{
+    inserted = reserveSlots(bakerIndex, count, firstIndex, orderPlacedAt);
+    return publish(bakerIndex, customerId, firstIndex, inserted);
+}
+
+void Oven::bakerFinished()
+{
+    bakersWorking.fetch_sub(1, memory_order_release);
+    profiledLock(&lock);
+    clockCondSignal(&breadArrived);
+    profiledUnlock(&lock);
+}
+
+void Oven::run(int ovenIndex)
+{
+    vector<OrderCompletion *> done;
+    while (true)
+    {
+        Cell *cell = &cells[head & ringMask];
+        if (cell->sequence.load(memory_order_acquire) != head + 1)
+        {
+            // Bakers publish before they finish, so no bread can show up after this.
+            if (bakersWorking.load(memory_order_acquire) == 0 && cell->sequence.load(memory_order_acquire) != head + 1)
+            {
+                break;
+            }
+
+            profiledLock(&lock);
+            ovenSleeping.store(true, memory_order_seq_cst);
+            while (cell->sequence.load(memory_order_seq_cst) != head + 1 && bakersWorking.load(memory_order_acquire) > 0)
+            {
+                clockCondWait(&breadArrived, &lock);
+            }
+            ovenSleeping.store(false, memory_order_relaxed);
+            profiledUnlock(&lock);
+            continue;
+        }
+
+        // Sleep until the oldest bread is baked. Later breads are not due earlier, except by the
+        // skew described at publish(); those come out with it.
+        if (clockNow() < cell->bread.readyAt)
+        {
+            clockSleepUntil(cell->bread.readyAt);
+            continue;
+        }
+
+        // Take out every bread that is due, then hand their slots back in one go.
+        long long now = clockNow();
+        int runLength = 0; // breads of the same order in a row, logged together
+        while (cell->sequence.load(memory_order_acquire) == head + 1 && cell->bread.readyAt <= now)
+        {
+            Bread bread = cell->bread;
+            done.push_back(completions[bread.bakerIndex]);
+            head++;
+            cell = &cells[head & ringMask];
+            runLength++;
+            bool runEnds = cell->sequence.load(memory_order_acquire) != head + 1 || cell->bread.readyAt > now ||
+                           cell->bread.bakerIndex != bread.bakerIndex || cell->bread.customerId != bread.customerId;
+            if (runEnds)
+            {
+                logEvent(LogLevel::Trace, EventType::BreadsOut, ActorKind::Oven, ovenIndex, bread.customerId, runLength, bread.bakerIndex);
+                runLength = 0;
+            }
+        }
+        releaseSlots(done.size());
+        baked.store(baked.load(memory_order_relaxed) + done.size(), memory_order_relaxed);
+        for (OrderCompletion *completion : done)
+        {
+            orderCompletionBreadDone(completion);
+        }
+        done.clear();
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef OVEN_H
+#define OVEN_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "lockprof.h"
+#include "pthread.h"
+#include "sim_clock.h"
+
+// Counts down as the oven takes an order's breads out; the baker waits on it before delivery.
+struct OrderCompletion
+{
+    int remainingBreads;
+    long long lastBreadOutAt;
+    ProfiledMutex lock;
+    ClockCond done;
+};
+
+void orderCompletionInit(OrderCompletion *completion);
+void orderCompletionDestroy(OrderCompletion *completion);
+// Arms the completion for a new order of `breadCount` breads.
+void orderCompletionStart(OrderCompletion *completion, int breadCount);
+void orderCompletionWait(OrderCompletion *completion);
+
+struct Bread
+{
+    long long readyAt; // clockNow() at which the bread is baked
+    uint32_t customerId;
+    uint16_t index;      // position of the bread within its order
+    uint16_t bakerIndex; // selects the order's OrderCompletion
+};
+
+static_assert(sizeof(Bread) <= 16 && std::is_trivially_copyable_v<Bread>, "Bread must stay a small POD");
+
+// Limits of --bakers and --max-breads, so that every index fits in a Bread.
+const int MAX_BAKERS = UINT16_MAX;
+const int MAX_ORDER_BREADS = UINT16_MAX;
+
+// How a baker picks the oven for each batch of breads it puts in.
+enum class OvenPolicy
+{
+    Static,      // baker i always uses oven i % ovens
+    LeastLoaded, // the oven with the lowest occupied fraction
+    TwoChoices,  // the less loaded of two ovens picked at random
+};
+
+// Parses static, least-loaded or two-choices; false for anything else.
+bool parseOvenPolicy(const std::string &name, OvenPolicy &policy);
+
+// Which waiting baker gets oven slots first once some free up.
+enum class AdmissionPolicy
+{
+    Fifo,             // in the order the bakers asked
+    ShortestFirst,    // fewest breads still to go in
+    FairShare,        // fair queueing over bakers: each baker's breads are charged in turn
+    EarliestDeadline, // an order is due one bake time per bread after it was placed
+};
+
+// Parses fifo, shortest-first, fair-share or earliest-deadline; false for anything else.
+bool parseAdmissionPolicy(const std::string &name, AdmissionPolicy &policy);
+
+// The queue of bakers waiting for oven slots, ordered by an AdmissionPolicy. Each baker
+// has at most one request queued. Not thread-safe; the oven's lock guards it.
+class AdmissionScheduler
+{
+public:
+    struct Request
+    {
+        long long key; // smaller is served first; ties go by ticket
+        unsigned long long ticket;
+        int bakerIndex;
+        int count; // slots wanted; the baker takes any part of them
+    };
+
+    void init(AdmissionPolicy policy, int bakerCount, long long bakingTime);
+
+    // Queues a request for breads firstIndex..firstIndex + count - 1 of the baker's order.
+    void add(int bakerIndex, int count, int firstIndex, long long orderPlacedAt);
+    bool empty() const { return waiting.empty(); }
+    const Request &front() const { return waiting.back(); }
+    // Removes front(), which was granted `granted` slots.
+    void pop(int granted);
+
+private:
+    AdmissionPolicy policy;
+    long long bakingTime;
+    unsigned long long tickets;
+    long long virtualTime;            // fair share: start tag of the request served last
+    std::vector<long long> finishTags; // fair share: per baker, where its next request starts
+    std::vector<Request> waiting;     // sorted, the next request to serve last
+};
+
+// The shared oven: a bounded ring of breads filled by any number of bakers and
+// emptied by the oven thread in insertion order. With one bake time for every
+// bread, insertion order is also deadline order, up to the time a baker can be held
+// up between reading the clock and claiming its slots (see publish()).
+//
+// Capacity is tracked by an atomic free-slot counter, so a baker claims room for a
+// whole batch with one compare-and-swap and publishes the breads without a lock.
+// The mutex and conditions are only touched by a baker that has to wait for room
+// and by the oven thread when it runs out of bread. Bakers that wait queue up in an
+// AdmissionScheduler, and while any baker waits, freed slots go out in its order.
+class Oven
+{
+public:
+    Oven() = default;
+    Oven(const Oven &) = delete;
+    Oven &operator=(const Oven &) = delete;
+
+    // *completions[bakerIndex] is counted down as that baker's breads come out.
+    void init(int capacity, int bakingTime, AdmissionPolicy admission, const std::vector<OrderCompletion *> &completions);
+    void destroy();
+
+    int capacity() const { return slots; }
+    int occupancy() const { return slots - freeSlots.load(std::memory_order_relaxed); }
+    // Breads taken out so far.
+    long long bakedBreads() const { return baked.load(std::memory_order_relaxed); }
+
+    // Puts breads firstIndex.. of the baker's current order, placed at orderPlacedAt, in with a
+    // single slot reservation and returns the clockNow() time at which they went in. Waits only
+    // while the oven is full, takes as many of the `count` slots as are free and stores how
+    // many it got in `inserted`.
+    long long insertAvailable(int bakerIndex, uint32_t customerId, long long orderPlacedAt, int firstIndex, int count,
+                              int &inserted);
+    // Called by each baker once it will not insert any more bread.
+    void bakerFinished();
+    // Oven thread body: takes breads out as they are baked until every baker has finished.
+    // `ovenIndex` only names the oven in the event log.
+    void run(int ovenIndex);
+
+private:
+    struct Cell
+    {
+        std::atomic<unsigned long long> sequence; // position + 1 once the bread is published
+        Bread bread;
+    };
+
+    int reserveSlots(int bakerIndex, int count, int firstIndex, long long orderPlacedAt);
+    void releaseSlots(int count);
+    void grantWaiting();
+    long long publish(int bakerIndex, uint32_t customerId, int firstIndex, int count);
+
+    int slots;
+    long long bakingTime;
+    unsigned long long ringMask;
+    Cell *cells;
+    std::vector<OrderCompletion *> completions; // one per baker
+    unsigned long long head; // oven thread only
+    std::atomic<long long> baked; // written by the oven thread only
+
+    alignas(64) std::atomic<unsigned long long> tail;
+    alignas(64) std::atomic<int> freeSlots;
+    alignas(64) std::atomic<int> slotWaiters;
+    std::atomic<bool> ovenSleeping;
+    std::atomic<int> bakersWorking;
+
+    ProfiledMutex lock;
+    AdmissionScheduler admission;        // guarded by lock
+    std::vector<int> grants;             // guarded by lock: slots granted to each queued baker
+    std::vector<ClockCond> slotsGranted; // one per baker, so a grant wakes exactly its baker
+    ClockCond breadArrived;              // bread published or baker finished
+};
+
+#endif
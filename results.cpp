@@ -0,0 +1,259 @@
+#include "results.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include "pthread.h"
+
+using namespace std;
+
+bool resultsEnabled = false;
+
+static const char RESULTS_MAGIC[8] = {'B', 'A', 'K', 'E', 'R', 'E', 'S', '1'};
+static const uint32_t ROW_SIZE = 8 + 4 + 4 * 4 + 4 * 8;
+
+// Rows a thread buffers before handing them to the writer, and rows per block.
+static const size_t CHUNK_ROWS = 4096;
+static const size_t BLOCK_ROWS = 1 << 16;
+
+// Rows of one thread that the writer has not taken yet; written by that thread only.
+struct ResultBuffer
+{
+    vector<OrderResult> rows;
+};
+
+static FILE *sink;
+static string sinkPath;
+
+// Buffers of every thread that delivered an order in the current run. Like the event
+// log's rings they outlive their threads; resultsStop() writes what is left in them.
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<ResultBuffer *> buffers;
+static unsigned generation = 0;
+
+static thread_local ResultBuffer *threadBuffer = nullptr;
+static thread_local unsigned threadGeneration = 0;
+
+// Full chunks on their way to the writer.
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerWake = PTHREAD_COND_INITIALIZER;
+static deque<vector<OrderResult>> fullChunks;
+static bool writerStopping;
+static pthread_t writerHandler;
+static ResultColumns block; // the writer's, until it is joined
+
+void ResultColumns::append(const OrderResult &row)
+{
+    orderId.push_back(row.orderId);
+    customerId.push_back(row.customerId);
+    queue.push_back(row.queue);
+    baker.push_back(row.baker);
+    oven.push_back(row.oven);
+    breads.push_back(row.breads);
+    enqueuedAt.push_back(row.timestamps.enqueuedAt);
+    firstBreadInAt.push_back(row.timestamps.firstBreadInAt);
+    lastBreadOutAt.push_back(row.timestamps.lastBreadOutAt);
+    deliveredAt.push_back(row.timestamps.deliveredAt);
+}
+
+OrderResult ResultColumns::row(size_t index) const
+{
+    return OrderResult{orderId[index], customerId[index], queue[index], baker[index], oven[index], breads[index],
+                       OrderTimestamps{enqueuedAt[index], firstBreadInAt[index], lastBreadOutAt[index], deliveredAt[index]}};
+}
+
+void ResultColumns::clear()
+{
+    orderId.clear();
+    customerId.clear();
+    queue.clear();
+    baker.clear();
+    oven.clear();
+    breads.clear();
+    enqueuedAt.clear();
+    firstBreadInAt.clear();
+    lastBreadOutAt.clear();
+    deliveredAt.clear();
+}
+
+// Calls `transfer` on every column, in file order, while it succeeds.
+template <typename Columns, typename Transfer>
+static bool eachColumn(Columns &columns, Transfer transfer)
+{
+    return transfer(columns.orderId) && transfer(columns.customerId) && transfer(columns.queue) &&
+           transfer(columns.baker) && transfer(columns.oven) && transfer(columns.breads) &&
+           transfer(columns.enqueuedAt) && transfer(columns.firstBreadInAt) && transfer(columns.lastBreadOutAt) &&
+           transfer(columns.deliveredAt);
+}
+
+// A short write would leave a file the reader takes for a clean, shorter run.
+static void writeFailed()
+{
+    cerr << "cannot write results file " << sinkPath << ". exiting...\n";
+    exit(EXIT_FAILURE);
+}
+
+static void writeBlock(const ResultColumns &columns)
+{
+    if (columns.size() == 0)
+    {
+        return;
+    }
+    ResultsBlockHeader header{(uint32_t)columns.size(), 0};
+    bool written = fwrite(&header, sizeof(header), 1, sink) == 1 && eachColumn(columns, [](const auto &column) {
+        return fwrite(column.data(), sizeof(column[0]), column.size(), sink) == column.size();
+    });
+    if (!written)
+    {
+        writeFailed();
+    }
+}
+
+bool readResultsHeader(FILE *file)
+{
+    ResultsFileHeader header;
+    return fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, RESULTS_MAGIC, sizeof(RESULTS_MAGIC)) == 0 &&
+           header.rowSize == ROW_SIZE;
+}
+
+bool readResultsBlock(FILE *file, ResultColumns &columns)
+{
+    ResultsBlockHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1)
+    {
+        return false;
+    }
+    return eachColumn(columns, [file, &header](auto &column) {
+        column.resize(header.rows);
+        return fread(column.data(), sizeof(column[0]), header.rows, file) == header.rows;
+    });
+}
+
+// Appends handed-over chunks to the block and writes it out whenever it is full.
+static void *writer(void *arg)
+{
+    pthread_mutex_lock(&writerLock);
+    while (true)
+    {
+        while (fullChunks.empty() && !writerStopping)
+        {
+            pthread_cond_wait(&writerWake, &writerLock);
+        }
+        if (fullChunks.empty())
+        {
+            break;
+        }
+        vector<OrderResult> chunk = move(fullChunks.front());
+        fullChunks.pop_front();
+        pthread_mutex_unlock(&writerLock);
+
+        for (const OrderResult &row : chunk)
+        {
+            block.append(row);
+        }
+        if (block.size() >= BLOCK_ROWS)
+        {
+            writeBlock(block);
+            block.clear();
+        }
+        pthread_mutex_lock(&writerLock);
+    }
+    pthread_mutex_unlock(&writerLock);
+    return nullptr;
+}
+
+void resultsStart(const string &path)
+{
+    if (path.empty())
+    {
+        return;
+    }
+    sinkPath = path;
+    sink = fopen(path.c_str(), "wb");
+    if (sink == nullptr)
+    {
+        cerr << "cannot open results file " << path << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    ResultsFileHeader header{};
+    memcpy(header.magic, RESULTS_MAGIC, sizeof(RESULTS_MAGIC));
+    header.rowSize = ROW_SIZE;
+    if (fwrite(&header, sizeof(header), 1, sink) != 1)
+    {
+        writeFailed();
+    }
+
+    pthread_mutex_lock(&registryLock);
+    generation++;
+    pthread_mutex_unlock(&registryLock);
+    block.clear();
+    writerStopping = false;
+    pthread_create(&writerHandler, nullptr, &writer, nullptr);
+    resultsEnabled = true;
+}
+
+void resultsRecord(const OrderResult &row)
+{
+    if (threadBuffer == nullptr || threadGeneration != generation)
+    {
+        threadBuffer = new ResultBuffer();
+        threadBuffer->rows.reserve(CHUNK_ROWS);
+        pthread_mutex_lock(&registryLock);
+        threadGeneration = generation;
+        buffers.push_back(threadBuffer);
+        pthread_mutex_unlock(&registryLock);
+    }
+    threadBuffer->rows.push_back(row);
+    if (threadBuffer->rows.size() < CHUNK_ROWS)
+    {
+        return;
+    }
+
+    vector<OrderResult> chunk;
+    chunk.reserve(CHUNK_ROWS);
+    chunk.swap(threadBuffer->rows);
+    pthread_mutex_lock(&writerLock);
+    fullChunks.push_back(move(chunk));
+    pthread_cond_signal(&writerWake);
+    pthread_mutex_unlock(&writerLock);
+}
+
+void resultsStop()
+{
+    if (!resultsEnabled)
+    {
+        return;
+    }
+    resultsEnabled = false;
+    pthread_mutex_lock(&writerLock);
+    writerStopping = true;
+    pthread_cond_signal(&writerWake);
+    pthread_mutex_unlock(&writerLock);
+    pthread_join(writerHandler, nullptr);
+
+    // Every producer is done: what is left are the partial chunks.
+    pthread_mutex_lock(&registryLock);
+    for (ResultBuffer *buffer : buffers)
+    {
+        for (const OrderResult &row : buffer->rows)
+        {
+            block.append(row);
+            if (block.size() >= BLOCK_ROWS)
+            {
+                writeBlock(block);
+                block.clear();
+            }
+        }
+        delete buffer;
+    }
+    buffers.clear();
+    pthread_mutex_unlock(&registryLock);
+    writeBlock(block);
+    block.clear();
+    if (fclose(sink) != 0)
+    {
+        writeFailed();
+    }
+    sink = nullptr;
+}
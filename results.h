@@ -0,0 +1,79 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "metrics.h"
+
+// Per-order results file: one row per delivered order, for analysis after the run.
+// Deliveries append rows to a buffer of their own thread; full buffers go to a writer
+// thread, which turns them into columns and writes them out in large blocks.
+//
+// Layout, host byte order: a ResultsFileHeader, then blocks of a ResultsBlockHeader
+// followed by one array per column, in this order:
+//     orderId u64, customerId u32, queue u32, baker u32, oven u32, breads u32,
+//     enqueuedAt i64, firstBreadInAt i64, lastBreadOutAt i64, deliveredAt i64
+// Timestamps are clockNow() nanoseconds.
+
+struct ResultsFileHeader
+{
+    char magic[8];    // "BAKERES1"
+    uint32_t rowSize; // bytes per row over all columns
+    uint32_t reserved;
+};
+
+struct ResultsBlockHeader
+{
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+struct OrderResult
+{
+    uint64_t orderId;
+    uint32_t customerId;
+    uint32_t queue; // queue the customer ordered from
+    uint32_t baker; // baker that baked it
+    uint32_t oven;  // oven of the first batch
+    uint32_t breads;
+    OrderTimestamps timestamps;
+};
+
+// Rows of one block, column by column.
+struct ResultColumns
+{
+    std::vector<uint64_t> orderId;
+    std::vector<uint32_t> customerId;
+    std::vector<uint32_t> queue;
+    std::vector<uint32_t> baker;
+    std::vector<uint32_t> oven;
+    std::vector<uint32_t> breads;
+    std::vector<int64_t> enqueuedAt;
+    std::vector<int64_t> firstBreadInAt;
+    std::vector<int64_t> lastBreadOutAt;
+    std::vector<int64_t> deliveredAt;
+
+    size_t size() const { return orderId.size(); }
+    void append(const OrderResult &row);
+    OrderResult row(size_t index) const;
+    void clear();
+};
+
+// Used by the reader: false at the end of the file or if it is not a results file.
+bool readResultsHeader(FILE *file);
+// Replaces `columns` with the next block; false at the end of the file. A truncated
+// block counts as the end.
+bool readResultsBlock(FILE *file, ResultColumns &columns);
+
+// Opens `path` and starts the writer; does nothing for an empty path. Exits if the file
+// cannot be created or written.
+void resultsStart(const std::string &path);
+// Writes every buffered row and closes the file; called once the actors are done.
+void resultsStop();
+
+extern bool resultsEnabled;
+void resultsRecord(const OrderResult &row);
+
+#endif
@@ -0,0 +1,110 @@
+#include "results.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+using namespace std;
+
+// Reader for --results-file output: prints a summary of the run, or every row as CSV.
+
+void usage(const char *program)
+{
+    cerr << "Usage: " << program << " FILE [--csv]\n"
+         << "  (default)  orders, breads and order-to-delivery latency per queue, baker and oven\n"
+         << "  --csv      print every order as a CSV row instead\n";
+    exit(EXIT_FAILURE);
+}
+
+void printCsv(const ResultColumns &columns)
+{
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        printf("%llu,%u,%u,%u,%u,%u,%lld,%lld,%lld,%lld\n", (unsigned long long)columns.orderId[i], columns.customerId[i],
+               columns.queue[i], columns.baker[i], columns.oven[i], columns.breads[i], (long long)columns.enqueuedAt[i],
+               (long long)columns.firstBreadInAt[i], (long long)columns.lastBreadOutAt[i], (long long)columns.deliveredAt[i]);
+    }
+}
+
+// Order-to-delivery samples grouped by one column's value.
+struct Group
+{
+    long long breads = 0;
+    LatencyHistogram latencies;
+};
+
+void printGroups(const char *title, map<int, Group> &groups)
+{
+    char row[256];
+    snprintf(row, sizeof(row), "%-10s %10s %12s %12s %12s %12s %12s\n", title, "orders", "breads", "mean", "p50", "p99", "max");
+    cout << row;
+    for (auto &[key, group] : groups)
+    {
+        long long breads = group.breads;
+        LatencySummary summary = group.latencies.summary();
+        string name = key < 0 ? "all" : to_string(key);
+        snprintf(row, sizeof(row), "%-10s %10zu %12lld %12s %12s %12s %12s\n", name.c_str(), summary.count, breads,
+                 formatDuration(summary.mean).c_str(), formatDuration(summary.p50).c_str(),
+                 formatDuration(summary.p99).c_str(), formatDuration(summary.max).c_str());
+        cout << row;
+    }
+    cout << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3 || (argc == 3 && string(argv[2]) != "--csv"))
+    {
+        usage(argv[0]);
+    }
+    bool csv = argc == 3;
+    FILE *file = fopen(argv[1], "rb");
+    if (file == nullptr || !readResultsHeader(file))
+    {
+        cerr << argv[1] << " is not a results file. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+
+    if (csv)
+    {
+        printf("order,customer,queue,baker,oven,breads,enqueued_ns,first_bread_in_ns,last_bread_out_ns,delivered_ns\n");
+    }
+    ResultColumns columns;
+    map<int, Group> queues, bakers, ovens;
+    long long blocks = 0, stolen = 0;
+    int64_t lastDelivery = 0;
+    while (readResultsBlock(file, columns))
+    {
+        blocks++;
+        if (csv)
+        {
+            printCsv(columns);
+            continue;
+        }
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            long long latency = columns.deliveredAt[i] - columns.enqueuedAt[i];
+            for (Group *group : {&queues[-1], &queues[columns.queue[i]], &bakers[columns.baker[i]], &ovens[columns.oven[i]]})
+            {
+                group->breads += columns.breads[i];
+                group->latencies.record(latency);
+            }
+            stolen += columns.baker[i] != columns.queue[i];
+            lastDelivery = max(lastDelivery, columns.deliveredAt[i]);
+        }
+    }
+    fclose(file);
+    if (csv)
+    {
+        return 0;
+    }
+
+    cout << "blocks: " << blocks << ", last delivery at " << formatDuration(lastDelivery) << ", stolen orders: " << stolen
+         << "\n\n";
+    printGroups("queue", queues);
+    printGroups("baker", bakers);
+    printGroups("oven", ovens);
+    return 0;
+}
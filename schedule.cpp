@@ -0,0 +1,146 @@
+#include "schedule.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+static const char SCHEDULE_MAGIC[8] = {'B', 'A', 'K', 'E', 'S', 'C', 'H', '1'};
+
+static ScheduleConfig config;
+static FILE *file;
+static mt19937_64 picker;
+static unsigned long long decision;
+static ScheduleRecord pending; // replay: the next recorded decision
+static bool pendingValid;
+static unsigned long long followed, seeded, skipped; // replay: how the picks were made
+
+static void readPending()
+{
+    pendingValid = fread(&pending, sizeof(pending), 1, file) == 1;
+}
+
+void scheduleStart(const ScheduleConfig &scheduleConfig)
+{
+    config = scheduleConfig;
+    decision = 0;
+    followed = seeded = skipped = 0;
+    picker.seed(config.seed);
+    if (config.mode != ScheduleMode::Record && config.mode != ScheduleMode::Replay)
+    {
+        return;
+    }
+
+    bool recording = config.mode == ScheduleMode::Record;
+    file = fopen(config.path.c_str(), recording ? "wb" : "rb");
+    if (file == nullptr)
+    {
+        cerr << "cannot open schedule file " << config.path << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    ScheduleFileHeader header{};
+    if (recording)
+    {
+        memcpy(header.magic, SCHEDULE_MAGIC, sizeof(SCHEDULE_MAGIC));
+        header.recordSize = sizeof(ScheduleRecord);
+        header.seed = config.seed;
+        fwrite(&header, sizeof(header), 1, file);
+        return;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, SCHEDULE_MAGIC, sizeof(SCHEDULE_MAGIC)) != 0 ||
+        header.recordSize != sizeof(ScheduleRecord))
+    {
+        cerr << config.path << " is not a schedule file. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    // Picks the file does not cover are made the way the recorded run made them.
+    config.seed = header.seed;
+    picker.seed(header.seed);
+    readPending();
+}
+
+unsigned scheduleSeed()
+{
+    return config.seed;
+}
+
+void scheduleStop()
+{
+    if (config.mode == ScheduleMode::Replay)
+    {
+        while (pendingValid)
+        {
+            skipped++;
+            readPending();
+        }
+        if (seeded > 0 || skipped > 0)
+        {
+            cerr << "replay of " << config.path << " diverged: " << followed << " picks followed the schedule, "
+                 << seeded << " were seeded instead and " << skipped << " recorded picks went unused\n";
+        }
+    }
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+// Replay: follows the next recorded pick if the run is at the same clock reading and the
+// recorded actor can run. Records the run has moved past are dropped, and a pick the file
+// has no answer for is seeded, so the replay picks the schedule back up wherever the two
+// runs line up again.
+static bool replayPick(long long at, const vector<int> &candidates, size_t &pick)
+{
+    while (pendingValid && pending.at < at)
+    {
+        skipped++;
+        readPending();
+    }
+    if (!pendingValid || pending.at != at)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        if (candidates[i] == (int)pending.actor)
+        {
+            pick = i;
+            readPending();
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t schedulePick(long long at, const vector<int> &candidates)
+{
+    unsigned long long current = decision++;
+    if (candidates.size() == 1)
+    {
+        return 0;
+    }
+    size_t pick = uniform_int_distribution<size_t>(0, candidates.size() - 1)(picker);
+    if (config.mode == ScheduleMode::Replay)
+    {
+        if (replayPick(at, candidates, pick))
+        {
+            followed++;
+        }
+        else
+        {
+            seeded++;
+        }
+        return pick;
+    }
+    if (config.mode == ScheduleMode::Record)
+    {
+        ScheduleRecord record{current, at, (uint32_t)candidates[pick], (uint32_t)candidates.size()};
+        fwrite(&record, sizeof(record), 1, file);
+    }
+    return pick;
+}
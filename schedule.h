@@ -0,0 +1,69 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic scheduling for reproducible runs. In virtual time the actors then run one
+// at a time, handing over whenever the running one blocks (see simClockStart()). Each
+// hand-over where more than one actor could run next is a scheduling decision: which
+// customer reaches the baker first, which baker gets oven slots, which pickup wins. A
+// seeded pick makes those decisions; they can be recorded to a file and replayed from it,
+// so two builds can be compared on the same sequence of events.
+//
+// A record names the actor that ran and the clock reading of the hand-over, not a thread
+// wake-up order. When the code under test adds or removes hand-overs, a replay follows the
+// recorded picks wherever the clock and the runnable actors still line up, seeds the rest,
+// and reports how many picks it could not follow. The two runs are then only as close as
+// the share of followed picks.
+
+enum class ScheduleMode : uint8_t
+{
+    Free,   // threads run in parallel, as the OS schedules them
+    Seeded, // serialized, decisions picked with the seed
+    Record, // like Seeded, and every decision is written to the file
+    Replay, // serialized, decisions read from the file
+};
+
+struct ScheduleConfig
+{
+    ScheduleMode mode;
+    std::string path; // Record and Replay
+    unsigned seed;
+};
+
+struct ScheduleFileHeader
+{
+    char magic[8];       // "BAKESCH1"
+    uint32_t recordSize; // sizeof(ScheduleRecord)
+    uint32_t seed;
+};
+
+// One hand-over that had a choice. Hand-overs with a single candidate are counted in
+// `decision` but not written. Replay matches records on `at` and `actor`; `decision` and
+// `candidates` are for inspecting a file.
+struct ScheduleRecord
+{
+    uint64_t decision; // hand-over number within the run
+    int64_t at;        // clockNow()
+    uint32_t actor;    // the actor that ran next
+    uint32_t candidates;
+};
+
+static_assert(sizeof(ScheduleRecord) == 24, "ScheduleRecord is a file format");
+
+// Opens the record or replay file; exits if it cannot. Does nothing in Free mode.
+void scheduleStart(const ScheduleConfig &config);
+// Closes the file; a replay that did not follow its file exactly says so on stderr.
+void scheduleStop();
+// The seed of the run (a replay's is the recorded one), for choices the actors make
+// themselves; valid after scheduleStart().
+unsigned scheduleSeed();
+
+// Called by the virtual clock with its lock held at every hand-over. `candidates` are the
+// runnable actors' ids in the order they became runnable; returns the index of the one to
+// run next.
+size_t schedulePick(long long at, const std::vector<int> &candidates);
+
+#endif
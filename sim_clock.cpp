@@ -0,0 +1,560 @@
+#include "sim_clock.h"
+
+#include "lockprof.h"
+#include "schedule.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// A thread blocked in clockCondTimedWait(); lives on the waiter's stack.
+struct TimedWaiter
+{
+    long long deadline;
+    unsigned long long seq;
+    ClockCond *cond;
+    pthread_mutex_t *mutex;
+    bool fired; // set by the driver when virtual time reaches the deadline
+    struct SerialWaiter *serial; // serialized mode: the waiting actor
+};
+
+struct TimedWaiterEarlier
+{
+    bool operator()(const TimedWaiter *a, const TimedWaiter *b) const
+    {
+        if (a->deadline != b->deadline)
+        {
+            return a->deadline < b->deadline;
+        }
+        return a->seq < b->seq;
+    }
+};
+
+static bool virtualMode = false;
+static long long realStart = 0;
+static atomic<long long> virtualNow{0};
+
+// Everything below is virtual-mode bookkeeping, guarded by clockLock.
+static ProfiledMutex clockLock = {PTHREAD_MUTEX_INITIALIZER, LockName::VirtualClock, 0};
+static pthread_cond_t driverCondition = PTHREAD_COND_INITIALIZER;
+static int runningActors = 0;
+static bool clockStopped = false;
+static unsigned long long nextTimerSeq = 0;
+static set<TimedWaiter *, TimedWaiterEarlier> timers;
+static pthread_t driverHandler;
+
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static ClockCond sleepCondition;
+
+// ------ Serialized mode --------
+// Actors run one at a time: the one in `current` runs, the runnable ones wait for their
+// turn, and when the current one blocks or exits schedulePick() chooses its successor.
+// ClockCond waiters queue up in FIFO order, so a signal always wakes the same actor.
+// Guarded by clockLock, like the rest of the virtual-mode state.
+struct Actor
+{
+    int id; // in spawn order, so the same across runs
+    pthread_cond_t turn;
+};
+
+struct SerialWaiter
+{
+    Actor *actor;
+    TimedWaiter *timer; // null for an untimed wait
+    bool signaled;
+};
+
+static bool serialized = false;
+static vector<unique_ptr<Actor>> actors;
+static Actor *current = nullptr;
+static deque<Actor *> runnable;
+static unordered_map<ClockCond *, deque<SerialWaiter *>> serialWaiters;
+static thread_local Actor *self = nullptr;
+
+static long long monotonicNow()
+{
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOS_PER_SEC + now.tv_nsec;
+}
+
+static timespec toTimespec(long long nanoseconds)
+{
+    timespec ts{};
+    ts.tv_sec = nanoseconds / NANOS_PER_SEC;
+    ts.tv_nsec = nanoseconds % NANOS_PER_SEC;
+    return ts;
+}
+
+// clockLock must be held.
+static void actorBlocked()
+{
+    if (--runningActors == 0)
+    {
+        pthread_cond_signal(&driverCondition);
+    }
+}
+
+static void waitOnClockLock(pthread_cond_t *cond)
+{
+    if (lockProfiling)
+    {
+        lockProfiledSleep(&clockLock);
+    }
+    pthread_cond_wait(cond, &clockLock.mutex);
+    if (lockProfiling)
+    {
+        lockProfiledWake(&clockLock);
+    }
+}
+
+// The serialized-mode helpers below expect clockLock to be held.
+
+// Gives the turn to one of the runnable actors, unless someone has it.
+static void dispatch()
+{
+    if (current != nullptr || runnable.empty())
+    {
+        return;
+    }
+    vector<int> candidates;
+    for (Actor *actor : runnable)
+    {
+        candidates.push_back(actor->id);
+    }
+    size_t pick = schedulePick(virtualNow.load(memory_order_relaxed), candidates);
+    current = runnable[pick];
+    runnable.erase(runnable.begin() + pick);
+    pthread_cond_signal(&current->turn);
+}
+
+static void makeRunnable(Actor *actor)
+{
+    runningActors++;
+    runnable.push_back(actor);
+    dispatch();
+}
+
+// The current actor blocks or exits.
+static void yieldTurn()
+{
+    current = nullptr;
+    actorBlocked();
+    dispatch();
+}
+
+static void waitForTurn()
+{
+    while (current != self)
+    {
+        waitOnClockLock(&self->turn);
+    }
+}
+
+static Actor *newActor()
+{
+    actors.push_back(make_unique<Actor>());
+    Actor *actor = actors.back().get();
+    actor->id = actors.size() - 1;
+    pthread_cond_init(&actor->turn, nullptr);
+    return actor;
+}
+
+// Wakes the longest waiting actor on `c`, or all of them.
+static void serialWake(ClockCond *c, bool all)
+{
+    auto found = serialWaiters.find(c);
+    if (found == serialWaiters.end())
+    {
+        return;
+    }
+    deque<SerialWaiter *> &waiting = found->second;
+    while (!waiting.empty())
+    {
+        SerialWaiter *waiter = waiting.front();
+        waiting.pop_front();
+        waiter->signaled = true;
+        if (waiter->timer != nullptr)
+        {
+            timers.erase(waiter->timer);
+        }
+        makeRunnable(waiter->actor);
+        if (!all)
+        {
+            break;
+        }
+    }
+}
+
+// Advances virtual time. Whenever no actor can make progress it pops the earliest
+// timed waiter, moves the clock to its deadline and hands it a running slot.
+static void *clockDriver(void *arg)
+{
+    profiledLock(&clockLock);
+    while (!clockStopped)
+    {
+        if (runningActors > 0 || timers.empty())
+        {
+            waitOnClockLock(&driverCondition);
+            continue;
+        }
+
+        TimedWaiter *next = *timers.begin();
+        timers.erase(timers.begin());
+        if (next->deadline > virtualNow.load(memory_order_relaxed))
+        {
+            virtualNow.store(next->deadline, memory_order_relaxed);
+        }
+        next->fired = true;
+        if (serialized)
+        {
+            deque<SerialWaiter *> &waiting = serialWaiters[next->cond];
+            waiting.erase(find(waiting.begin(), waiting.end(), next->serial));
+            makeRunnable(next->serial->actor);
+            continue;
+        }
+        runningActors++;
+        ClockCond *cond = next->cond;
+        pthread_mutex_t *mutex = next->mutex;
+        profiledUnlock(&clockLock);
+
+        // Taking the waiter's mutex guarantees it is parked in pthread_cond_wait().
+        pthread_mutex_lock(mutex);
+        pthread_cond_broadcast(&cond->cond);
+        pthread_mutex_unlock(mutex);
+
+        profiledLock(&clockLock);
+    }
+    profiledUnlock(&clockLock);
+    return nullptr;
+}
+
+void simClockStart(bool virtualTime, bool serialize)
+{
+    virtualMode = virtualTime;
+    serialized = virtualTime && serialize;
+    current = nullptr;
+    runnable.clear();
+    serialWaiters.clear();
+    realStart = monotonicNow();
+    virtualNow.store(0);
+    runningActors = 0;
+    clockStopped = false;
+    timers.clear();
+    clockCondInit(&sleepCondition);
+
+    if (virtualMode)
+    {
+        pthread_create(&driverHandler, nullptr, &clockDriver, nullptr);
+    }
+}
+
+void simClockStop()
+{
+    if (virtualMode)
+    {
+        profiledLock(&clockLock);
+        clockStopped = true;
+        pthread_cond_signal(&driverCondition);
+        profiledUnlock(&clockLock);
+        pthread_join(driverHandler, nullptr);
+    }
+    clockCondDestroy(&sleepCondition);
+    for (unique_ptr<Actor> &actor : actors)
+    {
+        pthread_cond_destroy(&actor->turn);
+    }
+    actors.clear();
+    serialized = false;
+}
+
+long long clockNow()
+{
+    if (virtualMode)
+    {
+        return virtualNow.load(memory_order_relaxed);
+    }
+    return monotonicNow() - realStart;
+}
+
+void clockActorStart()
+{
+    if (!virtualMode)
+    {
+        return;
+    }
+    profiledLock(&clockLock);
+    if (serialized)
+    {
+        self = newActor();
+        makeRunnable(self);
+        waitForTurn();
+    }
+    else
+    {
+        runningActors++;
+    }
+    profiledUnlock(&clockLock);
+}
+
+struct SpawnedActor
+{
+    Actor *actor;
+    void *(*body)(void *);
+    void *arg;
+};
+
+// A serialized actor's first steps: wait for the turn, then run the body.
+static void *startSpawned(void *arg)
+{
+    SpawnedActor spawned = *(SpawnedActor *)arg;
+    delete (SpawnedActor *)arg;
+    profiledLock(&clockLock);
+    self = spawned.actor;
+    waitForTurn();
+    profiledUnlock(&clockLock);
+    return spawned.body(spawned.arg);
+}
+
+void clockActorSpawn(pthread_t *thread, void *(*body)(void *), void *arg)
+{
+    if (!serialized)
+    {
+        clockActorStart();
+        pthread_create(thread, nullptr, body, arg);
+        return;
+    }
+    profiledLock(&clockLock);
+    Actor *actor = newActor();
+    makeRunnable(actor);
+    profiledUnlock(&clockLock);
+    pthread_create(thread, nullptr, &startSpawned, new SpawnedActor{actor, body, arg});
+}
+
+void clockActorExit()
+{
+    if (!virtualMode)
+    {
+        return;
+    }
+    profiledLock(&clockLock);
+    if (serialized)
+    {
+        yieldTurn();
+    }
+    else
+    {
+        actorBlocked();
+    }
+    profiledUnlock(&clockLock);
+}
+
+void clockSleep(long long nanoseconds)
+{
+    clockSleepUntil(clockNow() + nanoseconds);
+}
+
+void clockSleepUntil(long long deadline)
+{
+    if (!virtualMode)
+    {
+        timespec ts = toTimespec(realStart + deadline);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        {
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&sleepLock);
+    while (clockNow() < deadline)
+    {
+        clockCondTimedWait(&sleepCondition, &sleepLock, deadline);
+    }
+    pthread_mutex_unlock(&sleepLock);
+}
+
+void clockCondInit(ClockCond *c)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    c->waiters = 0;
+    c->wakeups = 0;
+}
+
+void clockCondDestroy(ClockCond *c)
+{
+    pthread_cond_destroy(&c->cond);
+}
+
+// Virtual-mode wait. The caller holds mutex. A blocked waiter stops counting as
+// running; whoever wakes it (a signaler or the driver) counts it back in.
+// Timed waits must use a ClockCond that outlives the run, since the driver may
+// still broadcast on it after the waiter has gone.
+static bool virtualWait(ClockCond *c, pthread_mutex_t *mutex, TimedWaiter *timer)
+{
+    c->waiters++;
+    profiledLock(&clockLock);
+    if (timer != nullptr)
+    {
+        timer->seq = nextTimerSeq++;
+        timers.insert(timer);
+    }
+    actorBlocked();
+    profiledUnlock(&clockLock);
+
+    bool signaled = false;
+    while (true)
+    {
+        if (c->wakeups > 0)
+        {
+            c->wakeups--;
+            signaled = true;
+            break;
+        }
+        if (timer != nullptr)
+        {
+            profiledLock(&clockLock);
+            bool fired = timer->fired;
+            profiledUnlock(&clockLock);
+            if (fired)
+            {
+                break;
+            }
+        }
+        pthread_cond_wait(&c->cond, mutex);
+    }
+    c->waiters--;
+
+    if (timer != nullptr)
+    {
+        profiledLock(&clockLock);
+        if (!timer->fired)
+        {
+            timers.erase(timer);
+        }
+        else if (signaled)
+        {
+            // Both the signaler and the driver counted us back in.
+            actorBlocked();
+        }
+        profiledUnlock(&clockLock);
+    }
+    return signaled;
+}
+
+// Serialized-mode wait: queue up on `c`, hand the turn on, and once woken by a signal or
+// the driver wait for the turn before taking the mutex back.
+static bool serialWait(ClockCond *c, pthread_mutex_t *mutex, TimedWaiter *timer)
+{
+    SerialWaiter waiter{self, timer, false};
+    profiledLock(&clockLock);
+    serialWaiters[c].push_back(&waiter);
+    if (timer != nullptr)
+    {
+        timer->seq = nextTimerSeq++;
+        timer->serial = &waiter;
+        timers.insert(timer);
+    }
+    yieldTurn();
+    profiledUnlock(&clockLock);
+
+    // Whoever runs now takes the mutex only to signal us, once we are queued.
+    pthread_mutex_unlock(mutex);
+    profiledLock(&clockLock);
+    waitForTurn();
+    profiledUnlock(&clockLock);
+    pthread_mutex_lock(mutex);
+    return waiter.signaled;
+}
+
+void clockCondWait(ClockCond *c, pthread_mutex_t *mutex)
+{
+    if (!virtualMode)
+    {
+        pthread_cond_wait(&c->cond, mutex);
+        return;
+    }
+    if (serialized)
+    {
+        serialWait(c, mutex, nullptr);
+        return;
+    }
+    virtualWait(c, mutex, nullptr);
+}
+
+bool clockCondTimedWait(ClockCond *c, pthread_mutex_t *mutex, long long deadline)
+{
+    if (!virtualMode)
+    {
+        timespec ts = toTimespec(realStart + deadline);
+        return pthread_cond_timedwait(&c->cond, mutex, &ts) != ETIMEDOUT;
+    }
+    if (deadline <= clockNow())
+    {
+        return false;
+    }
+    TimedWaiter timer{deadline, 0, c, mutex, false, nullptr};
+    if (serialized)
+    {
+        return serialWait(c, mutex, &timer);
+    }
+    return virtualWait(c, mutex, &timer);
+}
+
+void clockCondSignal(ClockCond *c)
+{
+    if (serialized)
+    {
+        profiledLock(&clockLock);
+        serialWake(c, false);
+        profiledUnlock(&clockLock);
+        return;
+    }
+    if (virtualMode)
+    {
+        if (c->waiters <= c->wakeups)
+        {
+            return;
+        }
+        c->wakeups++;
+        profiledLock(&clockLock);
+        runningActors++;
+        profiledUnlock(&clockLock);
+    }
+    pthread_cond_signal(&c->cond);
+}
+
+void clockCondBroadcast(ClockCond *c)
+{
+    if (serialized)
+    {
+        profiledLock(&clockLock);
+        serialWake(c, true);
+        profiledUnlock(&clockLock);
+        return;
+    }
+    if (virtualMode)
+    {
+        int granted = c->waiters - c->wakeups;
+        if (granted <= 0)
+        {
+            return;
+        }
+        c->wakeups += granted;
+        profiledLock(&clockLock);
+        runningActors += granted;
+        profiledUnlock(&clockLock);
+    }
+    pthread_cond_broadcast(&c->cond);
+}
@@ -0,0 +1,56 @@
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <pthread.h>
+
+// Simulation clock shared by all bakery modes.
+//
+// In real-time mode clockNow() is CLOCK_MONOTONIC and every wait below maps
+// straight onto the matching pthread call. In virtual-time mode the clock only
+// moves when every registered actor thread is blocked in one of these waits;
+// it then jumps to the earliest pending deadline and wakes that waiter. Any
+// thread that takes part in the simulation must be registered with
+// clockActorSpawn() or clockActorStart(), end with clockActorExit() and must
+// block only through this API.
+//
+// Serialized virtual time (see schedule.h) runs one actor at a time, so every
+// race is decided by schedulePick() instead of the OS.
+
+const long long NANOS_PER_SEC = 1000000000LL;
+
+// A condition variable whose waiters the virtual clock can account for.
+// Signal and broadcast must be called with the waiters' mutex held.
+struct ClockCond
+{
+    pthread_cond_t cond;
+    int waiters;
+    int wakeups; // signals granted but not yet consumed by a waiter
+};
+
+// `serialize` only applies to virtual time.
+void simClockStart(bool virtualTime, bool serialize = false);
+void simClockStop();
+
+// Nanoseconds since simClockStart().
+long long clockNow();
+
+// Starts a thread running body(arg) as a new actor. The caller should be an actor
+// itself, so virtual time cannot move while the actors are still being spawned.
+void clockActorSpawn(pthread_t *thread, void *(*body)(void *), void *arg);
+// Makes the calling thread an actor: main() wraps spawning in a start/exit pair.
+void clockActorStart();
+// Called by every actor right before it exits.
+void clockActorExit();
+
+void clockSleep(long long nanoseconds);
+void clockSleepUntil(long long deadline);
+
+void clockCondInit(ClockCond *c);
+void clockCondDestroy(ClockCond *c);
+void clockCondWait(ClockCond *c, pthread_mutex_t *mutex);
+// Returns false if the deadline (in clockNow() time) passed before a signal arrived.
+bool clockCondTimedWait(ClockCond *c, pthread_mutex_t *mutex, long long deadline);
+void clockCondSignal(ClockCond *c);
+void clockCondBroadcast(ClockCond *c);
+
+#endif
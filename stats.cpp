@@ -0,0 +1,230 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include "bakery.h"
+
+using namespace std;
+
+// One sample; the previous one turns counters into rates.
+struct StatsSample
+{
+    long long at; // clockNow()
+    vector<OvenGauge> ovens;
+    vector<long long> busyNanos; // per baker, counting the order in hand so far
+    long long baked;
+    long long deliveredOrders;
+};
+
+static Bakery *statsBakery;
+static function<OvenGauge(int)> readOvenGauge;
+static StatsSample previous;
+static long long failedWrites; // samples that did not reach the file, reported in the next one
+
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerStop;
+static bool writerStopping;
+static bool writerRunning = false;
+static pthread_t writerHandler;
+
+static StatsSample takeSample()
+{
+    const BakeryConfig &config = statsBakery->config;
+    StatsSample sample{};
+    sample.at = clockNow();
+    for (int i = 0; i < (int)config.ovens.size(); i++)
+    {
+        sample.ovens.push_back(readOvenGauge(i));
+        sample.baked += sample.ovens.back().baked;
+    }
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        const MetricsCollector::LiveQueue &live = statsBakery->metrics.live(i);
+        long long since = live.busySince.load(memory_order_relaxed);
+        long long busy = live.busyNanos.load(memory_order_relaxed);
+        sample.busyNanos.push_back(busy + (since >= 0 ? max(0LL, sample.at - since) : 0));
+        sample.deliveredOrders += live.deliveredOrders.load(memory_order_relaxed);
+    }
+    return sample;
+}
+
+static void metricHeader(FILE *file, const char *name, const char *type, const char *help)
+{
+    fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Rates and utilization cover the clock time since the previous sample. The file is
+// replaced in one rename, so readers never see half of it.
+static bool writeSample(const StatsSample &sample)
+{
+    const BakeryConfig &config = statsBakery->config;
+    const MetricsCollector &metrics = statsBakery->metrics;
+    string temporary = config.stats.path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    double seconds = (double)(sample.at - previous.at) / NANOS_PER_SEC;
+    auto perSecond = [seconds](long long now, long long before) { return seconds > 0 ? (now - before) / seconds : 0.0; };
+
+    metricHeader(file, "bakery_clock_seconds", "gauge", "Simulation clock since the start of the run.");
+    fprintf(file, "bakery_clock_seconds %.3f\n", (double)sample.at / NANOS_PER_SEC);
+
+    metricHeader(file, "bakery_oven_capacity_breads", "gauge", "Breads an oven holds at once.");
+    for (int i = 0; i < (int)sample.ovens.size(); i++)
+    {
+        fprintf(file, "bakery_oven_capacity_breads{oven=\"%d\"} %d\n", i, config.ovens[i].capacity);
+    }
+    metricHeader(file, "bakery_oven_occupancy_breads", "gauge", "Breads in an oven.");
+    for (int i = 0; i < (int)sample.ovens.size(); i++)
+    {
+        fprintf(file, "bakery_oven_occupancy_breads{oven=\"%d\"} %d\n", i, sample.ovens[i].occupied);
+    }
+    metricHeader(file, "bakery_oven_breads_baked_total", "counter", "Breads an oven took out.");
+    for (int i = 0; i < (int)sample.ovens.size(); i++)
+    {
+        fprintf(file, "bakery_oven_breads_baked_total{oven=\"%d\"} %lld\n", i, sample.ovens[i].baked);
+    }
+
+    // Queue gauges move in separate steps, so a sample can catch one a step early: clamp.
+    metricHeader(file, "bakery_request_queue_depth", "gauge", "Orders placed in a baker's queue and not yet taken.");
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        fprintf(file, "bakery_request_queue_depth{baker=\"%d\"} %lld\n", i,
+                max(0LL, metrics.live(i).queuedOrders.load(memory_order_relaxed)));
+    }
+    metricHeader(file, "bakery_delivery_queue_depth", "gauge", "Orders baked for a baker's queue and not yet collected.");
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        fprintf(file, "bakery_delivery_queue_depth{baker=\"%d\"} %lld\n", i,
+                max(0LL, metrics.live(i).awaitingPickup.load(memory_order_relaxed)));
+    }
+    metricHeader(file, "bakery_baker_utilization", "gauge", "Fraction of the last interval a baker spent on orders.");
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        double busy = perSecond(sample.busyNanos[i], previous.busyNanos[i]) / NANOS_PER_SEC;
+        fprintf(file, "bakery_baker_utilization{baker=\"%d\"} %.3f\n", i, min(1.0, max(0.0, busy)));
+    }
+    metricHeader(file, "bakery_orders_delivered_total", "counter", "Orders collected from a baker's queue.");
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        fprintf(file, "bakery_orders_delivered_total{baker=\"%d\"} %lld\n", i,
+                metrics.live(i).deliveredOrders.load(memory_order_relaxed));
+    }
+    metricHeader(file, "bakery_breads_delivered_total", "counter", "Breads collected from a baker's queue.");
+    for (int i = 0; i < config.bakerCount; i++)
+    {
+        fprintf(file, "bakery_breads_delivered_total{baker=\"%d\"} %lld\n", i,
+                metrics.live(i).deliveredBreads.load(memory_order_relaxed));
+    }
+
+    metricHeader(file, "bakery_breads_per_second", "gauge", "Breads baked per clock second over the last interval.");
+    fprintf(file, "bakery_breads_per_second %.3f\n", perSecond(sample.baked, previous.baked));
+    metricHeader(file, "bakery_orders_per_second", "gauge", "Orders delivered per clock second over the last interval.");
+    fprintf(file, "bakery_orders_per_second %.3f\n", perSecond(sample.deliveredOrders, previous.deliveredOrders));
+    metricHeader(file, "bakery_stats_write_failures_total", "counter", "Samples that could not be written to this file.");
+    fprintf(file, "bakery_stats_write_failures_total %lld\n", failedWrites);
+
+    bool written = fclose(file) == 0;
+    if (written && rename(temporary.c_str(), config.stats.path.c_str()) == 0)
+    {
+        return true;
+    }
+    remove(temporary.c_str());
+    return false;
+}
+
+static void sampleAndWrite(bool final)
+{
+    StatsSample sample = takeSample();
+    // Until the clock moves a sample would only have zero rates to show; the last one
+    // is written anyway, for the final counts.
+    if (sample.at > previous.at || final)
+    {
+        // Keep trying: the file may come back, and then shows how many samples were lost.
+        if (!writeSample(sample) && failedWrites++ == 0)
+        {
+            cerr << "cannot write stats file " << statsBakery->config.stats.path
+                 << "; it stays stale until a write succeeds\n";
+        }
+        previous = sample;
+    }
+}
+
+// Not a clock actor: it samples on the wall clock in real and virtual time alike.
+static void *writer(void *arg)
+{
+    long long interval = statsBakery->config.stats.intervalMs * 1000000LL;
+    pthread_mutex_lock(&writerLock);
+    while (!writerStopping)
+    {
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        long long next = deadline.tv_sec * NANOS_PER_SEC + deadline.tv_nsec + interval;
+        deadline.tv_sec = next / NANOS_PER_SEC;
+        deadline.tv_nsec = next % NANOS_PER_SEC;
+        if (pthread_cond_timedwait(&writerStop, &writerLock, &deadline) == 0)
+        {
+            continue;
+        }
+        pthread_mutex_unlock(&writerLock);
+        sampleAndWrite(false);
+        pthread_mutex_lock(&writerLock);
+    }
+    pthread_mutex_unlock(&writerLock);
+    return nullptr;
+}
+
+void statsStart(Bakery &bakery, function<OvenGauge(int)> readOven)
+{
+    if (bakery.config.stats.path.empty())
+    {
+        return;
+    }
+    statsBakery = &bakery;
+    readOvenGauge = readOven;
+    failedWrites = 0;
+    previous = takeSample();
+    if (!writeSample(previous))
+    {
+        cerr << "cannot write stats file " << bakery.config.stats.path << ". exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&writerStop, &attributes);
+    pthread_condattr_destroy(&attributes);
+    writerStopping = false;
+    pthread_create(&writerHandler, nullptr, &writer, nullptr);
+    writerRunning = true;
+}
+
+void statsStop()
+{
+    if (!writerRunning)
+    {
+        return;
+    }
+    pthread_mutex_lock(&writerLock);
+    writerStopping = true;
+    pthread_cond_signal(&writerStop);
+    pthread_mutex_unlock(&writerLock);
+    pthread_join(writerHandler, nullptr);
+    pthread_cond_destroy(&writerStop);
+    writerRunning = false;
+
+    sampleAndWrite(true);
+    if (failedWrites > 0)
+    {
+        cerr << "stats file " << statsBakery->config.stats.path << ": " << failedWrites
+             << " samples could not be written\n";
+    }
+    readOvenGauge = nullptr;
+}
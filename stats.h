@@ -0,0 +1,34 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <functional>
+#include <string>
+
+struct Bakery;
+
+// Live stats: while a run goes on, a background thread samples oven occupancy, queue
+// depths, throughput and baker utilization and rewrites a file in the Prometheus text
+// format (e.g. for node_exporter's textfile collector). Sampling reads relaxed atomics
+// only, so it never takes a lock the bakers or ovens use.
+
+struct StatsConfig
+{
+    std::string path; // empty: no stats
+    int intervalMs;   // wall-clock time between samples
+};
+
+// What the writer reads of one oven, without locking it.
+struct OvenGauge
+{
+    int occupied;     // breads in the oven
+    long long baked;  // breads taken out so far
+};
+
+// Called by the backend once its ovens exist; readOven(i) samples oven i. Writes the
+// first sample before returning and exits if the file cannot be written. Later failed
+// writes are reported on stderr once, counted in the file, and summed up by statsStop().
+void statsStart(Bakery &bakery, std::function<OvenGauge(int)> readOven);
+// Writes a last sample and stops the writer; called before the ovens go away.
+void statsStop();
+
+#endif
@@ -0,0 +1,299 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include "bakery.h"
+
+using namespace std;
+
+uint32_t CustomerNames::intern(const string &name)
+{
+    auto found = ids.find(name);
+    if (found != ids.end())
+    {
+        return found->second;
+    }
+    uint32_t customerId = names.size();
+    names.push_back(name);
+    ids.emplace(name, customerId);
+    return customerId;
+}
+
+RequestOrderSource::RequestOrderSource(const vector<Request> &requests)
+    : requests(requests), customerIds(requests.size()), positions(requests.size(), 0)
+{
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        for (const auto &request : requests[i].requests)
+        {
+            customerIds[i].push_back(names.intern(request.first));
+        }
+    }
+}
+
+bool RequestOrderSource::next(int bakerIndex, OrderSpec &order)
+{
+    if (bakerIndex >= (int)requests.size() || positions[bakerIndex] >= requests[bakerIndex].requests.size())
+    {
+        return false;
+    }
+    size_t position = positions[bakerIndex]++;
+    order.customerId = customerIds[bakerIndex][position];
+    order.breadCount = requests[bakerIndex].requests[position].second;
+    order.arrivalAt = 0;
+    order.thinkTime = 0;
+    return true;
+}
+
+WorkloadConfig defaultWorkloadConfig()
+{
+    WorkloadConfig config{};
+    config.enabled = false;
+    config.orders = 1000;
+    config.arrival = ArrivalProcess::ClosedLoop;
+    config.rate = 1.0;
+    config.burstSize = 10;
+    config.thinkTime = 0;
+    config.breads = BreadDistribution::Uniform;
+    config.breadMean = 4;
+    config.queueSkew = 0;
+    config.seed = 1;
+    return config;
+}
+
+const char *workloadUsage()
+{
+    return "  --workload KIND     generate customers instead of reading stdin: closed, poisson or bursty\n"
+           "  --orders N          generated orders over all queues (default: 1000)\n"
+           "  --rate R            poisson/bursty: orders per second over all queues (default: 1)\n"
+           "  --burst-size N      bursty: orders arriving together (default: 10)\n"
+           "  --think-time S      closed: mean seconds between a delivery and the next order (default: 0)\n"
+           "  --bread-dist KIND   uniform, geometric or fixed (default: uniform)\n"
+           "  --bread-mean X      geometric/fixed: mean breads per order (default: 4)\n"
+           "  --queue-skew S      Zipf exponent of queue popularity, 0 = even (default: 0)\n"
+           "  --seed N            workload seed (default: 1)\n";
+}
+
+static double parseNumber(const string &flag, const char *value, bool allowZero)
+{
+    char *end = nullptr;
+    double number = value == nullptr ? -1 : strtod(value, &end);
+    if (value == nullptr || *end != '\0' || number < 0 || (!allowZero && number == 0))
+    {
+        cerr << flag << " expects a " << (allowZero ? "non-negative" : "positive") << " number. exiting...\n";
+        exit(EXIT_FAILURE);
+    }
+    return number;
+}
+
+bool parseWorkloadFlag(const string &flag, const char *value, WorkloadConfig &config)
+{
+    if (flag == "--workload")
+    {
+        string kind = value == nullptr ? "" : value;
+        if (kind == "closed")
+        {
+            config.arrival = ArrivalProcess::ClosedLoop;
+        }
+        else if (kind == "poisson")
+        {
+            config.arrival = ArrivalProcess::Poisson;
+        }
+        else if (kind == "bursty")
+        {
+            config.arrival = ArrivalProcess::Bursty;
+        }
+        else
+        {
+            cerr << "--workload expects closed, poisson or bursty. exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+        config.enabled = true;
+    }
+    else if (flag == "--orders")
+    {
+        config.orders = (long long)parseNumber(flag, value, false);
+    }
+    else if (flag == "--rate")
+    {
+        config.rate = parseNumber(flag, value, false);
+    }
+    else if (flag == "--burst-size")
+    {
+        config.burstSize = (int)parseNumber(flag, value, false);
+    }
+    else if (flag == "--think-time")
+    {
+        config.thinkTime = parseNumber(flag, value, true);
+    }
+    else if (flag == "--bread-dist")
+    {
+        string kind = value == nullptr ? "" : value;
+        if (kind == "uniform")
+        {
+            config.breads = BreadDistribution::Uniform;
+        }
+        else if (kind == "geometric")
+        {
+            config.breads = BreadDistribution::Geometric;
+        }
+        else if (kind == "fixed")
+        {
+            config.breads = BreadDistribution::Fixed;
+        }
+        else
+        {
+            cerr << "--bread-dist expects uniform, geometric or fixed. exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (flag == "--bread-mean")
+    {
+        config.breadMean = parseNumber(flag, value, false);
+    }
+    else if (flag == "--queue-skew")
+    {
+        config.queueSkew = parseNumber(flag, value, true);
+    }
+    else if (flag == "--seed")
+    {
+        config.seed = (unsigned)parseNumber(flag, value, true);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadConfig &config, int bakerCount, int maxCustomerBreads)
+    : config(config), maxCustomerBreads(maxCustomerBreads), queues(bakerCount)
+{
+    // Zipf popularity over the queues; orders and arrival rate are split by it.
+    vector<double> weights(bakerCount);
+    double total = 0;
+    for (int i = 0; i < bakerCount; i++)
+    {
+        weights[i] = 1.0 / pow(i + 1, config.queueSkew);
+        total += weights[i];
+    }
+
+    // Largest-remainder apportionment so the queue counts add up to exactly config.orders.
+    long long assigned = 0;
+    vector<pair<double, int>> remainders;
+    for (int i = 0; i < bakerCount; i++)
+    {
+        double share = config.orders * weights[i] / total;
+        queues[i].remaining = (long long)share;
+        assigned += queues[i].remaining;
+        remainders.push_back(make_pair(share - queues[i].remaining, i));
+    }
+    sort(remainders.begin(), remainders.end(), [](const pair<double, int> &a, const pair<double, int> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    for (size_t i = 0; assigned < config.orders; i++, assigned++)
+    {
+        queues[remainders[i % remainders.size()].second].remaining++;
+    }
+
+    // Customer ids interleave the queues (see next()), so the busiest queue bounds them.
+    long long idsPerQueue = UINT32_MAX / bakerCount;
+    for (int i = 0; i < bakerCount; i++)
+    {
+        if (queues[i].remaining > idsPerQueue)
+        {
+            cerr << "--orders gives queue " << i << " " << queues[i].remaining << " orders, more than the "
+                 << idsPerQueue << " customer ids of a queue. exiting...\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < bakerCount; i++)
+    {
+        QueueStream &stream = queues[i];
+        stream.random.seed(config.seed * 1000003ULL + i);
+        stream.generated = 0;
+        stream.rate = config.rate * weights[i] / total;
+        stream.nextArrival = 0;
+        stream.burstLeft = 0;
+    }
+}
+
+int WorkloadGenerator::nextBreadCount(QueueStream &stream)
+{
+    int count;
+    switch (config.breads)
+    {
+    case BreadDistribution::Geometric:
+    {
+        // Number of trials up to the first success, so the mean is breadMean.
+        geometric_distribution<int> distribution(1.0 / max(1.0, config.breadMean));
+        count = 1 + distribution(stream.random);
+        break;
+    }
+    case BreadDistribution::Fixed:
+        count = (int)llround(config.breadMean);
+        break;
+    default:
+    {
+        uniform_int_distribution<int> distribution(1, maxCustomerBreads);
+        count = distribution(stream.random);
+        break;
+    }
+    }
+    return max(1, min(count, maxCustomerBreads));
+}
+
+string WorkloadGenerator::customerName(uint32_t customerId) const
+{
+    return "q" + to_string(customerId % queues.size()) + "_c" + to_string(customerId / queues.size());
+}
+
+bool WorkloadGenerator::next(int bakerIndex, OrderSpec &order)
+{
+    QueueStream &stream = queues[bakerIndex];
+    if (stream.remaining == 0)
+    {
+        return false;
+    }
+    stream.remaining--;
+
+    order.customerId = stream.generated++ * queues.size() + bakerIndex;
+    order.breadCount = nextBreadCount(stream);
+    order.arrivalAt = 0;
+    order.thinkTime = 0;
+
+    switch (config.arrival)
+    {
+    case ArrivalProcess::ClosedLoop:
+        if (config.thinkTime > 0)
+        {
+            exponential_distribution<double> think(1.0 / config.thinkTime);
+            order.thinkTime = (long long)(think(stream.random) * NANOS_PER_SEC);
+        }
+        break;
+    case ArrivalProcess::Poisson:
+    {
+        exponential_distribution<double> gap(stream.rate);
+        stream.nextArrival += gap(stream.random);
+        order.arrivalAt = (long long)(stream.nextArrival * NANOS_PER_SEC);
+        break;
+    }
+    case ArrivalProcess::Bursty:
+    {
+        // Gaps average burstSize / rate, so the long-run rate is still `rate`.
+        if (stream.burstLeft == 0)
+        {
+            exponential_distribution<double> gap(stream.rate / config.burstSize);
+            stream.nextArrival += gap(stream.random);
+            stream.burstLeft = config.burstSize;
+        }
+        stream.burstLeft--;
+        order.arrivalAt = (long long)(stream.nextArrival * NANOS_PER_SEC);
+        break;
+    }
+    }
+    return true;
+}
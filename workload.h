@@ -0,0 +1,127 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Request;
+
+// Interns customer names once at input time so orders and breads only carry a 32-bit id.
+class CustomerNames
+{
+public:
+    uint32_t intern(const std::string &name);
+    const std::string &name(uint32_t customerId) const { return names[customerId]; }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+// One customer order as produced by an OrderSource.
+struct OrderSpec
+{
+    uint32_t customerId; // see OrderSource::customerName()
+    int breadCount;
+    long long arrivalAt; // open loop: clockNow() at which the customer shows up
+    long long thinkTime; // closed loop: pause between the previous delivery and this order
+};
+
+// Streams the orders of every baker queue. next() is only ever called by the single
+// agent that feeds a given queue, so sources keep independent per-queue state.
+class OrderSource
+{
+public:
+    virtual ~OrderSource() = default;
+    // Fills the next order of the queue; false once the queue has no more orders.
+    virtual bool next(int bakerIndex, OrderSpec &order) = 0;
+    // Closed loop: a queue's next order is sent only after the previous one was delivered.
+    virtual bool closedLoop() const = 0;
+    // Name of a customerId handed out by next(); only needed for printing.
+    virtual std::string customerName(uint32_t customerId) const = 0;
+    // Why the source stopped early (every queue then ran out of orders), or empty.
+    virtual std::string error() const { return ""; }
+};
+
+// Orders read from stdin (see readQueue()), all present at time zero.
+class RequestOrderSource : public OrderSource
+{
+public:
+    explicit RequestOrderSource(const std::vector<Request> &requests);
+    bool next(int bakerIndex, OrderSpec &order) override;
+    bool closedLoop() const override { return true; }
+    std::string customerName(uint32_t customerId) const override { return names.name(customerId); }
+
+private:
+    const std::vector<Request> &requests;
+    std::vector<std::vector<uint32_t>> customerIds; // per queue, parallel to requests
+    std::vector<size_t> positions;
+    CustomerNames names;
+};
+
+enum class ArrivalProcess
+{
+    ClosedLoop, // each queue orders again right after (or a think time after) its delivery
+    Poisson,    // exponential inter-arrival times
+    Bursty,     // bursts of simultaneous orders separated by exponential gaps
+};
+
+enum class BreadDistribution
+{
+    Uniform,   // 1..maxCustomerBreads
+    Geometric, // mean breadMean, capped at maxCustomerBreads
+    Fixed,     // always breadMean
+};
+
+struct WorkloadConfig
+{
+    bool enabled;
+    long long orders;     // total over all queues
+    ArrivalProcess arrival;
+    double rate;          // open loop: orders per second over all queues
+    int burstSize;        // bursty: orders per burst
+    double thinkTime;     // closed loop: mean seconds between delivery and the next order
+    BreadDistribution breads;
+    double breadMean;
+    double queueSkew;     // Zipf exponent of the queue popularity; 0 spreads evenly
+    unsigned seed;
+};
+
+WorkloadConfig defaultWorkloadConfig();
+
+// Handles one --workload/--orders/... command line flag; returns false if the flag is not a workload flag.
+bool parseWorkloadFlag(const std::string &flag, const char *value, WorkloadConfig &config);
+const char *workloadUsage();
+
+// Synthetic customers generated lazily, one queue at a time, in constant memory per queue.
+// Customer n of queue q gets id n * bakerCount + q, so no name table is needed.
+class WorkloadGenerator : public OrderSource
+{
+public:
+    WorkloadGenerator(const WorkloadConfig &config, int bakerCount, int maxCustomerBreads);
+    bool next(int bakerIndex, OrderSpec &order) override;
+    bool closedLoop() const override { return config.arrival == ArrivalProcess::ClosedLoop; }
+    std::string customerName(uint32_t customerId) const override;
+
+private:
+    struct QueueStream
+    {
+        std::mt19937_64 random;
+        long long remaining;
+        long long generated;
+        double rate;        // orders per second for this queue
+        double nextArrival; // seconds
+        int burstLeft;
+    };
+
+    int nextBreadCount(QueueStream &stream);
+
+    WorkloadConfig config;
+    int maxCustomerBreads;
+    std::vector<QueueStream> queues;
+};
+
+#endif